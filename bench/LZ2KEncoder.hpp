@@ -0,0 +1,396 @@
+#ifndef LZ2K_ENCODER_HPP
+#define LZ2K_ENCODER_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <queue>
+#include <span>
+#include <utility>
+#include <vector>
+
+namespace bench
+{
+    // Minimal LZ2K (LHA -lh5-) encoder producing entries for lz2k::LZ2K to decode:
+    // greedy matching over short hash chains, then one Huffman coded block per BLOCK_SYMBOLS symbols.
+    // It aims at valid, reasonably compressed data, not at the ratio of the original tools.
+    class LZ2KEncoder
+    {
+        public:
+            static constexpr std::size_t DEFAULT_CHUNK_SIZE = 0x20000;
+
+            // A whole entry: chunks of at most chunkSize bytes, each with its "LZ2K" header
+            static std::vector<std::byte> encodeEntry(std::span<const std::byte> data, std::size_t chunkSize = DEFAULT_CHUNK_SIZE);
+            static std::vector<std::byte> encodeChunk(std::span<const std::byte> data);
+
+        private:
+            static constexpr unsigned NC = 510;
+            static constexpr unsigned NP = 14;
+            static constexpr unsigned NT = 19;
+            static constexpr unsigned CBIT = 9;
+            static constexpr unsigned PBIT = 4;
+            static constexpr unsigned TBIT = 5;
+            static constexpr std::size_t DICSIZ = 8192;
+            static constexpr std::size_t MAXMATCH = 256;
+            static constexpr std::size_t THRESHOLD = 3;
+            static constexpr std::size_t MAX_CHAIN = 8;
+            static constexpr std::size_t BLOCK_SYMBOLS = 4000;
+            static constexpr unsigned NO_SYMBOL = 0xFFFF;
+
+            struct Symbol {
+                std::uint16_t _code; // Literal, or match length + 253
+                std::uint16_t _distance; // Match distance - 1
+            };
+
+            class BitWriter
+            {
+                public:
+                    void put(unsigned bitCount, std::uint32_t value);
+                    std::vector<std::byte> finish();
+
+                private:
+                    std::vector<std::byte> _out;
+                    std::uint32_t _pending{0};
+                    unsigned _pendingCount{0};
+            };
+
+            static std::vector<Symbol> _match(std::span<const std::byte> data);
+            // Code lengths of at most 16 bits; returns the symbol when only one (or none) is used, NO_SYMBOL otherwise
+            static unsigned _codeLengths(std::vector<std::uint32_t> frequencies, std::vector<std::uint8_t> &lengths);
+            static std::vector<std::uint16_t> _codes(const std::vector<std::uint8_t> &lengths);
+            static unsigned _distanceCode(unsigned distance) noexcept;
+            static void _writePtLen(BitWriter &writer, const std::vector<std::uint8_t> &lengths, unsigned bitCount, int special);
+            static void _encodeBlock(BitWriter &writer, std::span<const Symbol> symbols);
+    };
+
+    void LZ2KEncoder::BitWriter::put(unsigned bitCount, std::uint32_t value)
+    {
+        for (unsigned bit = bitCount; bit-- > 0;) {
+            _pending = (_pending << 1) | ((value >> bit) & 1u);
+            if (++_pendingCount == 8) {
+                _out.push_back(static_cast<std::byte>(_pending));
+                _pending = 0;
+                _pendingCount = 0;
+            }
+        }
+    }
+
+    std::vector<std::byte> LZ2KEncoder::BitWriter::finish()
+    {
+        if (_pendingCount != 0) {
+            _out.push_back(static_cast<std::byte>(_pending << (8 - _pendingCount)));
+        }
+        _out.push_back(std::byte{0});
+        return std::move(_out);
+    }
+
+    std::vector<LZ2KEncoder::Symbol> LZ2KEncoder::_match(std::span<const std::byte> data)
+    {
+        static constexpr std::size_t HASH_SIZE = 1ull << 15;
+        static constexpr std::uint32_t NO_POSITION = 0xFFFFFFFF;
+        std::vector<std::uint32_t> head(HASH_SIZE, NO_POSITION);
+        std::vector<std::uint32_t> previous(data.size(), NO_POSITION);
+        std::vector<Symbol> symbols;
+
+        auto hashAt = [&data](std::size_t position) {
+            const std::uint32_t key = std::to_integer<std::uint32_t>(data[position]) << 16 |
+                std::to_integer<std::uint32_t>(data[position + 1]) << 8 | std::to_integer<std::uint32_t>(data[position + 2]);
+            return (key * 2654435761u) >> 17;
+        };
+        auto insert = [&](std::size_t position) {
+            if (position + THRESHOLD <= data.size()) {
+                const std::uint32_t hash = hashAt(position);
+                previous[position] = head[hash];
+                head[hash] = static_cast<std::uint32_t>(position);
+            }
+        };
+
+        std::size_t position = 0ull;
+        while (position < data.size()) {
+            std::size_t bestLength = 0ull;
+            std::size_t bestDistance = 0ull;
+            if (position + THRESHOLD <= data.size()) {
+                std::uint32_t candidate = head[hashAt(position)];
+                const std::size_t limit = std::min(MAXMATCH, data.size() - position);
+                for (std::size_t chain = 0ull; chain < MAX_CHAIN && candidate != NO_POSITION && position - candidate <= DICSIZ; ++chain) {
+                    std::size_t length = 0ull;
+                    while (length < limit && data[candidate + length] == data[position + length]) {
+                        ++length;
+                    }
+                    if (length > bestLength) {
+                        bestLength = length;
+                        bestDistance = position - candidate;
+                    }
+                    candidate = previous[candidate];
+                }
+            }
+
+            if (bestLength >= THRESHOLD) {
+                symbols.push_back({static_cast<std::uint16_t>(bestLength + 0xFF + 1 - THRESHOLD), static_cast<std::uint16_t>(bestDistance - 1)});
+                for (std::size_t i = 0ull; i < bestLength; ++i) {
+                    insert(position + i);
+                }
+                position += bestLength;
+            } else {
+                symbols.push_back({std::to_integer<std::uint16_t>(data[position]), 0});
+                insert(position);
+                position += 1;
+            }
+        }
+        return symbols;
+    }
+
+    unsigned LZ2KEncoder::_codeLengths(std::vector<std::uint32_t> frequencies, std::vector<std::uint8_t> &lengths)
+    {
+        lengths.assign(frequencies.size(), 0);
+        std::vector<unsigned> used;
+        for (unsigned symbol = 0; symbol < frequencies.size(); ++symbol) {
+            if (frequencies[symbol] != 0) {
+                used.push_back(symbol);
+            }
+        }
+        if (used.size() <= 1) {
+            return used.empty() ? 0u : used[0];
+        }
+
+        // Plain Huffman construction; frequencies are halved until no code exceeds 16 bits
+        while (true) {
+            using Node = std::pair<std::uint64_t, std::size_t>;
+            std::priority_queue<Node, std::vector<Node>, std::greater<Node>> queue;
+            std::vector<std::size_t> parent(used.size(), 0);
+            for (std::size_t leaf = 0ull; leaf < used.size(); ++leaf) {
+                queue.emplace(frequencies[used[leaf]], leaf);
+            }
+            while (queue.size() > 1) {
+                const Node lhs = queue.top();
+                queue.pop();
+                const Node rhs = queue.top();
+                queue.pop();
+                const std::size_t node = parent.size();
+                parent.push_back(node);
+                parent[lhs.second] = node;
+                parent[rhs.second] = node;
+                queue.emplace(lhs.first + rhs.first, node);
+            }
+
+            unsigned longest = 0;
+            for (std::size_t leaf = 0ull; leaf < used.size(); ++leaf) {
+                unsigned depth = 0;
+                for (std::size_t node = leaf; parent[node] != node; node = parent[node]) {
+                    ++depth;
+                }
+                lengths[used[leaf]] = static_cast<std::uint8_t>(std::min(depth, 255u));
+                longest = std::max(longest, depth);
+            }
+            if (longest <= 16) {
+                return NO_SYMBOL;
+            }
+            for (std::uint32_t &frequency : frequencies) {
+                frequency = frequency == 0 ? 0 : (frequency + 1) / 2;
+            }
+        }
+    }
+
+    std::vector<std::uint16_t> LZ2KEncoder::_codes(const std::vector<std::uint8_t> &lengths)
+    {
+        std::uint16_t count[18] = {};
+        for (const std::uint8_t length : lengths) {
+            count[length] += 1;
+        }
+        count[0] = 0;
+
+        std::uint16_t next[18] = {};
+        std::uint32_t code = 0;
+        for (unsigned length = 1; length <= 16; ++length) {
+            code = (code + count[length - 1]) << 1;
+            next[length] = static_cast<std::uint16_t>(code);
+        }
+
+        std::vector<std::uint16_t> codes(lengths.size(), 0);
+        for (std::size_t symbol = 0ull; symbol < lengths.size(); ++symbol) {
+            if (lengths[symbol] != 0) {
+                codes[symbol] = next[lengths[symbol]]++;
+            }
+        }
+        return codes;
+    }
+
+    unsigned LZ2KEncoder::_distanceCode(unsigned distance) noexcept
+    {
+        unsigned bits = 0;
+        while (distance >> bits) {
+            ++bits;
+        }
+        return bits;
+    }
+
+    void LZ2KEncoder::_writePtLen(BitWriter &writer, const std::vector<std::uint8_t> &lengths, unsigned bitCount, int special)
+    {
+        unsigned count = static_cast<unsigned>(lengths.size());
+        while (count > 0 && lengths[count - 1] == 0) {
+            --count;
+        }
+        writer.put(bitCount, count);
+
+        unsigned i = 0;
+        while (i < count) {
+            const unsigned length = lengths[i++];
+            if (length <= 6) {
+                writer.put(3, length);
+            } else {
+                writer.put(length - 3, (1u << (length - 3)) - 2);
+            }
+            if (static_cast<int>(i) == special) {
+                while (i < 6 && lengths[i] == 0) {
+                    ++i;
+                }
+                writer.put(2, (i - 3) & 3);
+            }
+        }
+    }
+
+    void LZ2KEncoder::_encodeBlock(BitWriter &writer, std::span<const Symbol> symbols)
+    {
+        std::vector<std::uint32_t> cFrequencies(NC, 0);
+        std::vector<std::uint32_t> pFrequencies(NP, 0);
+        for (const Symbol &symbol : symbols) {
+            cFrequencies[symbol._code] += 1;
+            if (symbol._code > 0xFF) {
+                pFrequencies[_distanceCode(symbol._distance)] += 1;
+            }
+        }
+
+        std::vector<std::uint8_t> cLengths;
+        const unsigned cSingle = _codeLengths(cFrequencies, cLengths);
+        writer.put(16, static_cast<std::uint32_t>(symbols.size()));
+        if (cSingle != NO_SYMBOL) {
+            writer.put(TBIT, 0);
+            writer.put(TBIT, 0);
+            writer.put(CBIT, 0);
+            writer.put(CBIT, cSingle);
+        } else {
+            // Code lengths are themselves coded, with runs of zeros packed into tokens 0 to 2
+            unsigned count = NC;
+            while (count > 0 && cLengths[count - 1] == 0) {
+                --count;
+            }
+            struct Token {
+                unsigned _symbol;
+                unsigned _extraBits;
+                unsigned _extra;
+            };
+            std::vector<Token> tokens;
+            for (unsigned i = 0; i < count;) {
+                const unsigned length = cLengths[i++];
+                if (length != 0) {
+                    tokens.push_back({length + 2, 0, 0});
+                    continue;
+                }
+                unsigned run = 1;
+                while (i < count && cLengths[i] == 0) {
+                    ++i;
+                    ++run;
+                }
+                if (run <= 2) {
+                    tokens.insert(tokens.end(), run, Token{0, 0, 0});
+                } else if (run <= 18) {
+                    tokens.push_back({1, 4, run - 3});
+                } else if (run == 19) {
+                    tokens.push_back({0, 0, 0});
+                    tokens.push_back({1, 4, 15});
+                } else {
+                    tokens.push_back({2, CBIT, run - 20});
+                }
+            }
+
+            std::vector<std::uint32_t> tFrequencies(NT, 0);
+            for (const Token &token : tokens) {
+                tFrequencies[token._symbol] += 1;
+            }
+            std::vector<std::uint8_t> tLengths;
+            const unsigned tSingle = _codeLengths(tFrequencies, tLengths);
+            if (tSingle != NO_SYMBOL) {
+                writer.put(TBIT, 0);
+                writer.put(TBIT, tSingle);
+            } else {
+                _writePtLen(writer, tLengths, TBIT, 3);
+            }
+            const std::vector<std::uint16_t> tCodes = _codes(tLengths);
+            writer.put(CBIT, count);
+            for (const Token &token : tokens) {
+                if (tLengths[token._symbol] != 0) {
+                    writer.put(tLengths[token._symbol], tCodes[token._symbol]);
+                }
+                if (token._extraBits != 0) {
+                    writer.put(token._extraBits, token._extra);
+                }
+            }
+        }
+
+        std::vector<std::uint8_t> pLengths;
+        const unsigned pSingle = _codeLengths(pFrequencies, pLengths);
+        if (pSingle != NO_SYMBOL) {
+            writer.put(PBIT, 0);
+            writer.put(PBIT, pSingle);
+        } else {
+            _writePtLen(writer, pLengths, PBIT, -1);
+        }
+
+        const std::vector<std::uint16_t> cCodes = _codes(cLengths);
+        const std::vector<std::uint16_t> pCodes = _codes(pLengths);
+        for (const Symbol &symbol : symbols) {
+            if (cLengths[symbol._code] != 0) {
+                writer.put(cLengths[symbol._code], cCodes[symbol._code]);
+            }
+            if (symbol._code > 0xFF) {
+                const unsigned code = _distanceCode(symbol._distance);
+                if (pLengths[code] != 0) {
+                    writer.put(pLengths[code], pCodes[code]);
+                }
+                if (code > 1) {
+                    writer.put(code - 1, symbol._distance - (1u << (code - 1)));
+                }
+            }
+        }
+    }
+
+    std::vector<std::byte> LZ2KEncoder::encodeChunk(std::span<const std::byte> data)
+    {
+        BitWriter writer;
+        const std::vector<Symbol> symbols = _match(data);
+        for (std::size_t first = 0ull; first < symbols.size(); first += BLOCK_SYMBOLS) {
+            _encodeBlock(writer, std::span<const Symbol>(symbols).subspan(first, std::min(BLOCK_SYMBOLS, symbols.size() - first)));
+        }
+        return writer.finish();
+    }
+
+    std::vector<std::byte> LZ2KEncoder::encodeEntry(std::span<const std::byte> data, std::size_t chunkSize)
+    {
+        std::vector<std::byte> entry;
+        auto put32 = [&entry](std::uint32_t value) {
+            for (unsigned shift = 0; shift < 32; shift += 8) {
+                entry.push_back(static_cast<std::byte>(value >> shift));
+            }
+        };
+
+        for (std::size_t offset = 0ull; offset < data.size(); offset += chunkSize) {
+            const std::span<const std::byte> chunk = data.subspan(offset, std::min(chunkSize, data.size() - offset));
+            std::vector<std::byte> packed = encodeChunk(chunk);
+            const bool stored = packed.size() >= chunk.size();
+            for (const char c : {'L', 'Z', '2', 'K'}) {
+                entry.push_back(static_cast<std::byte>(c));
+            }
+            put32(static_cast<std::uint32_t>(chunk.size()));
+            put32(static_cast<std::uint32_t>(stored ? chunk.size() : packed.size()));
+            if (stored) {
+                entry.insert(entry.end(), chunk.begin(), chunk.end());
+            } else {
+                entry.insert(entry.end(), packed.begin(), packed.end());
+            }
+        }
+        return entry;
+    }
+} // namespace bench
+
+#endif // LZ2K_ENCODER_HPP
@@ -0,0 +1,297 @@
+// Stage by stage timings of the extraction pipeline on synthetic archives, using Google Benchmark.
+// Usage: bench [benchmark flags], e.g. --benchmark_filter=Parse
+// Results are also written as JSON to ntt-bench.json unless --benchmark_out is given.
+
+#include <benchmark/benchmark.h>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "DAT/Dat.hpp"
+#include "IO/DirectoryOutput.hpp"
+#include "IO/Output.hpp"
+#include "Utils/MemoryBudget.hpp"
+#include "Utils/ThreadPool.hpp"
+#include "SyntheticDat.hpp"
+#include "spdlog/spdlog.h"
+
+namespace
+{
+    // Stages in pipeline order, each one relying on the previous ones
+    enum class Stage {
+        Locate,
+        ParseChunk,
+        FilesOffset,
+        ComputeCRC,
+        Extract
+    };
+
+    struct Archive {
+        std::string _path;
+        std::size_t _entryCount;
+        std::size_t _totalSize;
+    };
+
+    // Archives are generated once per run and shared by every benchmark using the same options
+    class ArchiveCache
+    {
+        public:
+            ~ArchiveCache();
+
+            const Archive &get(const std::string &name, const bench::SyntheticDatOptions &options);
+
+        private:
+            std::map<std::string, Archive> _archives;
+    };
+
+    ArchiveCache::~ArchiveCache()
+    {
+        for (const auto &[name, archive] : _archives) {
+            std::error_code error;
+            std::filesystem::remove(archive._path, error);
+        }
+    }
+
+    const Archive &ArchiveCache::get(const std::string &name, const bench::SyntheticDatOptions &options)
+    {
+        auto found = _archives.find(name);
+        if (found == _archives.end()) {
+            const bench::SyntheticDat dat(options);
+            Archive archive{(std::filesystem::temp_directory_path() / ("ntt-bench-" + name + ".dat")).string(), dat.getFilePaths().size(), dat.getTotalSize()};
+            dat.writeTo(archive._path);
+            found = _archives.emplace(name, std::move(archive)).first;
+        }
+        return found->second;
+    }
+
+    ArchiveCache &archives()
+    {
+        static ArchiveCache cache;
+        return cache;
+    }
+
+    // Table of contents heavy archives: many tiny stored entries in a deep tree
+    const Archive &tocArchive(std::size_t entryCount)
+    {
+        bench::SyntheticDatOptions options;
+        options._entryCount = entryCount;
+        options._dirCount = 4096;
+        options._dirDepth = 6;
+        options._minNameLength = 8;
+        options._maxNameLength = 32;
+        options._minEntrySize = 0;
+        options._maxEntrySize = 64;
+        return archives().get("toc-" + std::to_string(entryCount), options);
+    }
+
+    // Data heavy archives, every entry using the same codec
+    const Archive &dataArchive(int codec)
+    {
+        static const char *names[] = {"stored", "zipx", "lz2k", "mixed"};
+        bench::SyntheticDatOptions options;
+        options._entryCount = 1000;
+        options._dirCount = 64;
+        options._minEntrySize = 1ull << 10;
+        options._maxEntrySize = 256ull << 10;
+        options._zipxShare = codec == 1 ? 1.0 : codec == 3 ? 0.4 : 0.0;
+        options._lz2kShare = codec == 2 ? 1.0 : codec == 3 ? 0.4 : 0.0;
+        return archives().get(std::string("data-") + names[codec], options);
+    }
+
+    void runStage(ntt::Dat &dat, Stage stage)
+    {
+        switch (stage) {
+            case Stage::Locate:
+                dat.setFilesChunkHeader(dat.getFilesChunkOffset(".CC40TAD"));
+                break;
+            case Stage::ParseChunk:
+                dat.parseFilesChunk();
+                break;
+            case Stage::FilesOffset:
+                dat.getFilesOffset();
+                break;
+            case Stage::ComputeCRC:
+                dat.setCRCdatabase();
+                dat.computeCRC();
+                break;
+            case Stage::Extract:
+                dat.readFilesBuffer();
+                break;
+        }
+    }
+
+    std::unique_ptr<ntt::Dat> openUntil(const Archive &archive, Stage stage)
+    {
+        auto dat = std::make_unique<ntt::Dat>(archive._path);
+        for (Stage done = Stage::Locate; done < stage; done = static_cast<Stage>(static_cast<int>(done) + 1)) {
+            runStage(*dat, done);
+        }
+        return dat;
+    }
+
+    // Stages cannot run twice on the same archive, so every iteration opens a fresh one outside of the timed region
+    void benchStage(benchmark::State &state, const Archive &archive, Stage stage)
+    {
+        for (auto _ : state) {
+            state.PauseTiming();
+            std::unique_ptr<ntt::Dat> dat = openUntil(archive, stage);
+            state.ResumeTiming();
+
+            runStage(*dat, stage);
+
+            state.PauseTiming();
+            dat.reset();
+            state.ResumeTiming();
+        }
+        state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * archive._entryCount));
+    }
+
+    // Swallows everything, so that decompression is measured without the file system
+    class NullOutput : public ntt::Output
+    {
+        public:
+            Result createDirectory(const std::string &path) override { return {Status::Written, path, {}}; }
+            void write(const std::string &path, std::span<const std::byte> data, std::vector<std::byte> owned, Completion onDone) override;
+            Result openStream(const std::string &path, std::size_t size, std::unique_ptr<Stream> &stream) override;
+            void wait() override {}
+            Stats getStats() const override { return {}; }
+
+        private:
+            class NullStream : public Stream
+            {
+                public:
+                    void write(std::span<const std::byte> data) override { benchmark::DoNotOptimize(data.data()); }
+                    void rewind() override {}
+                    Result close() override { return {Status::Written, {}, {}}; }
+            };
+    };
+
+    void NullOutput::write(const std::string &path, std::span<const std::byte> data, std::vector<std::byte>, Completion onDone)
+    {
+        benchmark::DoNotOptimize(data.data());
+        onDone({Status::Written, path, {}});
+    }
+
+    ntt::Output::Result NullOutput::openStream(const std::string &path, std::size_t, std::unique_ptr<Stream> &stream)
+    {
+        stream = std::make_unique<NullStream>();
+        return {Status::Written, path, {}};
+    }
+
+    // Schedules every entry of the archive and waits for the pool and the output to drain
+    void extractAll(ntt::Dat &dat, utils::ThreadPool &pool, ntt::Output &output)
+    {
+        utils::MemoryBudget budget;
+        dat.scheduleFiles(pool, output, budget, []() {});
+        pool.wait();
+        output.wait();
+    }
+
+    void BM_FooterSearch(benchmark::State &state)
+    {
+        const Archive &archive = tocArchive(static_cast<std::size_t>(state.range(0)));
+        ntt::Dat dat(archive._path);
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(dat.getFilesChunkOffset(".CC40TAD"));
+        }
+    }
+
+    void BM_ParseChunk(benchmark::State &state)
+    {
+        benchStage(state, tocArchive(static_cast<std::size_t>(state.range(0))), Stage::ParseChunk);
+    }
+
+    void BM_FilesOffset(benchmark::State &state)
+    {
+        benchStage(state, tocArchive(static_cast<std::size_t>(state.range(0))), Stage::FilesOffset);
+    }
+
+    void BM_ComputeCRC(benchmark::State &state)
+    {
+        benchStage(state, tocArchive(static_cast<std::size_t>(state.range(0))), Stage::ComputeCRC);
+    }
+
+    void BM_Decompress(benchmark::State &state)
+    {
+        const Archive &archive = dataArchive(static_cast<int>(state.range(0)));
+        utils::ThreadPool pool;
+        NullOutput output;
+        for (auto _ : state) {
+            state.PauseTiming();
+            std::unique_ptr<ntt::Dat> dat = openUntil(archive, Stage::Extract);
+            runStage(*dat, Stage::Extract);
+            state.ResumeTiming();
+
+            extractAll(*dat, pool, output);
+
+            state.PauseTiming();
+            dat.reset();
+            state.ResumeTiming();
+        }
+        state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations() * archive._totalSize));
+        state.counters["threads"] = static_cast<double>(pool.getThreadCount());
+    }
+
+    void BM_Output(benchmark::State &state)
+    {
+        const Archive &archive = dataArchive(0);
+        const std::filesystem::path root = std::filesystem::temp_directory_path() / "ntt-bench-output";
+        utils::ThreadPool pool;
+        ntt::Output::Stats stats;
+        for (auto _ : state) {
+            state.PauseTiming();
+            std::filesystem::remove_all(root);
+            std::unique_ptr<ntt::Dat> dat = openUntil(archive, Stage::Extract);
+            runStage(*dat, Stage::Extract);
+            auto output = std::make_unique<ntt::DirectoryOutput>(root.string(), static_cast<std::size_t>(state.range(0)));
+            state.ResumeTiming();
+
+            extractAll(*dat, pool, *output);
+
+            state.PauseTiming();
+            stats = output->getStats();
+            output.reset();
+            dat.reset();
+            state.ResumeTiming();
+        }
+        std::filesystem::remove_all(root);
+        state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations() * archive._totalSize));
+        state.counters["syscalls"] = static_cast<double>(stats._syscalls);
+    }
+} // namespace
+
+BENCHMARK(BM_FooterSearch)->RangeMultiplier(4)->Range(1 << 12, 1 << 18)->Unit(benchmark::kMillisecond);
+// Plus 500000 entries, the table size the parse times have always been measured on
+BENCHMARK(BM_ParseChunk)->RangeMultiplier(4)->Range(1 << 12, 1 << 18)->Arg(500000)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_FilesOffset)->RangeMultiplier(4)->Range(1 << 12, 1 << 18)->Arg(500000)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_ComputeCRC)->RangeMultiplier(4)->Range(1 << 12, 1 << 18)->Unit(benchmark::kMillisecond);
+// 0: stored, 1: ZIPX, 2: LZ2K, 3: mixed
+BENCHMARK(BM_Decompress)->DenseRange(0, 3)->Unit(benchmark::kMillisecond)->UseRealTime();
+// Writer thread count
+BENCHMARK(BM_Output)->Arg(1)->Arg(ntt::DirectoryOutput::DEFAULT_WRITERS)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+int main(int argc, char *argv[])
+{
+    std::vector<char *> arguments(argv, argv + argc);
+    std::string outFlag = "--benchmark_out=ntt-bench.json";
+    std::string formatFlag = "--benchmark_out_format=json";
+    bool hasOut = false;
+    for (int i = 1; i < argc; ++i) {
+        hasOut = hasOut || std::string_view(argv[i]).starts_with("--benchmark_out=");
+    }
+    if (!hasOut) {
+        arguments.push_back(outFlag.data());
+        arguments.push_back(formatFlag.data());
+    }
+
+    spdlog::set_level(spdlog::level::err);
+    int count = static_cast<int>(arguments.size());
+    benchmark::Initialize(&count, arguments.data());
+    if (benchmark::ReportUnrecognizedArguments(count, arguments.data())) {
+        return 1;
+    }
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -0,0 +1,191 @@
+#ifndef SYNTHETIC_DAT_HPP
+#define SYNTHETIC_DAT_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <random>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "LZ2KEncoder.hpp"
+#include "DAT/DatWriter.hpp"
+#include "Utils/PathHash.hpp"
+
+namespace bench
+{
+    struct SyntheticDatOptions {
+        std::size_t _entryCount{1000};
+        std::size_t _dirCount{64}; // Directories always come first so that 16 bits ids can reach them
+        std::size_t _dirDepth{4};
+        std::size_t _minNameLength{12};
+        std::size_t _maxNameLength{12};
+        std::size_t _minEntrySize{16}; // Entry sizes are spread log-uniformly between both bounds
+        std::size_t _maxEntrySize{16};
+        double _zipxShare{0.0}; // Shares of ZIPX and LZ2K packed entries, the others are stored
+        double _lz2kShare{0.0};
+        std::uint32_t _seed{1};
+    };
+
+    // Writes archives laid out the way ntt::FilesChunk reads them:
+    // entry data, then the big-endian table of contents introduced by ".CC40TAD" at the end of the file.
+    class SyntheticDat
+    {
+        public:
+            explicit SyntheticDat(const SyntheticDatOptions &options);
+
+            const std::vector<std::byte> &getBuffer() const noexcept { return _buffer; }
+            const std::vector<std::string> &getFilePaths() const noexcept { return _filePaths; }
+            // Sum of the unpacked entry sizes
+            std::size_t getTotalSize() const noexcept { return _totalSize; }
+
+            void writeTo(const std::string &path) const;
+
+        private:
+            struct Name {
+                std::string _name;
+                std::string _path;
+                std::uint16_t _parentId;
+                bool _isDir;
+            };
+
+            std::vector<std::byte> _buffer;
+            std::vector<std::string> _filePaths;
+            std::size_t _totalSize{0};
+
+            // Word salad, compressible about as well as the text and scripts found in real archives
+            static std::vector<std::byte> _makeContent(std::mt19937 &random, std::size_t size);
+    };
+
+    SyntheticDat::SyntheticDat(const SyntheticDatOptions &options)
+    {
+        if (options._dirCount > 0xFFFF) {
+            throw std::invalid_argument("Directory ids are 16 bits wide");
+        }
+        if (options._minNameLength > options._maxNameLength || options._minEntrySize > options._maxEntrySize) {
+            throw std::invalid_argument("Minimum bounds must not exceed maximum bounds");
+        }
+
+        std::mt19937 random(options._seed);
+        auto randomName = [&](std::size_t index, bool isDir) {
+            static constexpr char alphabet[] = "abcdefghijklmnopqrstuvwxyz0123456789_";
+            const std::size_t length = options._minNameLength + random() % (options._maxNameLength - options._minNameLength + 1);
+            std::string name = std::to_string(index) + "_";
+            while (name.size() < length) {
+                name.push_back(alphabet[random() % (sizeof(alphabet) - 1)]);
+            }
+            return isDir ? name : name + ".bin";
+        };
+
+        // Directories are spread evenly over _dirDepth levels, each one under a random directory of the level above
+        std::vector<Name> names;
+        const std::size_t dirsPerLevel = std::max<std::size_t>(1ull, (options._dirCount + options._dirDepth - 1) / std::max<std::size_t>(options._dirDepth, 1ull));
+        for (std::size_t dirIndex = 0ull; dirIndex < options._dirCount; ++dirIndex) {
+            const std::size_t level = dirIndex / dirsPerLevel;
+            std::uint16_t parentId = 0;
+            if (level > 0) {
+                parentId = static_cast<std::uint16_t>((level - 1) * dirsPerLevel + random() % dirsPerLevel + 1);
+            }
+            std::string name = randomName(dirIndex, true);
+            std::string path = parentId == 0 ? name : names[parentId - 1]._path + "/" + name;
+            names.push_back({name, path, parentId, true});
+        }
+
+        for (std::size_t fileIndex = 0ull; fileIndex < options._entryCount; ++fileIndex) {
+            std::uint16_t parentId = names.empty() ? 0 : static_cast<std::uint16_t>(1 + random() % options._dirCount);
+            std::string name = randomName(fileIndex, false);
+            std::string path = parentId == 0 ? name : names[parentId - 1]._path + "/" + name;
+            names.push_back({name, path, parentId, false});
+        }
+
+        // Entry data
+        for (const char c : std::string("NTT-SYNTHETIC-DAT")) {
+            _buffer.push_back(static_cast<std::byte>(c));
+        }
+        std::uniform_real_distribution<double> unit(0.0, 1.0);
+        auto randomSize = [&]() {
+            const double logMin = std::log(static_cast<double>(options._minEntrySize) + 1.0);
+            const double logMax = std::log(static_cast<double>(options._maxEntrySize) + 1.0);
+            const double size = std::exp(logMin + (logMax - logMin) * unit(random)) - 1.0;
+            return std::clamp(static_cast<std::size_t>(size), options._minEntrySize, options._maxEntrySize);
+        };
+        std::vector<ntt::DatWriter::FileRecord> records;
+        for (const Name &name : names) {
+            if (name._isDir) {
+                continue;
+            }
+            const std::vector<std::byte> content = _makeContent(random, randomSize());
+            const double codec = unit(random);
+            std::vector<std::byte> packed;
+            if (codec < options._zipxShare) {
+                packed = ntt::DatWriter::packZipx(content);
+            } else if (codec < options._zipxShare + options._lz2kShare) {
+                packed = LZ2KEncoder::encodeEntry(content);
+            }
+            // Entries that do not shrink are stored, like the original tools do
+            const std::vector<std::byte> &data = !packed.empty() && packed.size() < content.size() ? packed : content;
+
+            records.push_back({utils::pathHash(name._path), static_cast<std::uint32_t>(_buffer.size()),
+                static_cast<std::uint32_t>(data.size()), static_cast<std::uint32_t>(content.size())});
+            _buffer.insert(_buffer.end(), data.begin(), data.end());
+            _filePaths.push_back(name._path);
+            _totalSize += content.size();
+        }
+
+        // Table of contents, the one the pack command writes
+        std::vector<std::string> tableNames;
+        std::vector<std::uint16_t> parentIds;
+        tableNames.reserve(names.size());
+        parentIds.reserve(names.size());
+        for (const Name &name : names) {
+            tableNames.push_back(name._name);
+            parentIds.push_back(name._parentId);
+        }
+        const std::vector<std::byte> table = ntt::DatWriter::buildTable(tableNames, parentIds, std::move(records));
+        _buffer.insert(_buffer.end(), table.begin(), table.end());
+    }
+
+    std::vector<std::byte> SyntheticDat::_makeContent(std::mt19937 &random, std::size_t size)
+    {
+        static constexpr const char *words[] = {
+            "model", "texture", "param", "stage", "enemy", "script", "sound", "effect", "motion", "camera",
+            "light", "event", "table", "string", "player", "weapon", "boss", "menu", "save", "map"
+        };
+        std::vector<std::byte> content;
+        content.reserve(size);
+        while (content.size() < size) {
+            // Mostly words, sometimes a number or a random byte so that matches are not too regular
+            const std::uint32_t pick = random();
+            std::string token;
+            if (pick % 8 == 0) {
+                token = std::to_string(pick % 100000);
+            } else if (pick % 8 == 1) {
+                token.push_back(static_cast<char>(pick >> 8));
+            } else {
+                token = words[(pick >> 4) % std::size(words)];
+            }
+            token.push_back(pick % 16 == 2 ? '\n' : ' ');
+            for (const char c : token) {
+                if (content.size() == size) {
+                    break;
+                }
+                content.push_back(static_cast<std::byte>(c));
+            }
+        }
+        return content;
+    }
+
+    void SyntheticDat::writeTo(const std::string &path) const
+    {
+        std::ofstream file(path, std::ios::out | std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char *>(_buffer.data()), static_cast<std::streamsize>(_buffer.size()));
+        if (!file) {
+            throw std::ios_base::failure("Failed to write synthetic archive: " + path);
+        }
+    }
+} // namespace bench
+
+#endif // SYNTHETIC_DAT_HPP
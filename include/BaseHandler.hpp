@@ -1,14 +1,41 @@
 #ifndef BASE_HANDLER_HPP_
 #define BASE_HANDLER_HPP_
 
+#include <span>
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <vector>
+
 namespace ntt
 {
+    // A codec context. Instances are reused from one entry to the next,
+    // handle() decodes a whole compressed entry into an output sized to the entry's _fileSize
+    // and throws std::runtime_error when the data is corrupted.
     class BaseHandler
     {
         public:
-            virtual void handle() const = 0;
+            using Sink = std::function<void(std::span<const std::byte> chunk)>;
+
+            // Largest piece of output handed to a sink at once
+            static constexpr std::size_t STREAM_WINDOW = 256ull << 10;
+
+            virtual void handle(std::span<const std::byte> input, std::span<std::byte> output) = 0;
+
+            // Decodes an entry of outputSize bytes like handle(), but hands the output to sink in order,
+            // in pieces of at most STREAM_WINDOW bytes, so the whole entry never has to be held in memory.
+            // This fallback decodes everything first, codecs override it to keep their memory bounded.
+            virtual void handleStream(std::span<const std::byte> input, std::size_t outputSize, const Sink &sink)
+            {
+                std::vector<std::byte> output(outputSize);
+                handle(input, output);
+                for (std::size_t offset = 0ull; offset < output.size(); offset += STREAM_WINDOW) {
+                    sink(std::span<const std::byte>(output).subspan(offset, std::min(STREAM_WINDOW, output.size() - offset)));
+                }
+            }
+
             virtual ~BaseHandler() = default;
     };
 } // namespace ntt
 
-#endif // BASE_HANDLER_HPP_
\ No newline at end of file
+#endif // BASE_HANDLER_HPP_
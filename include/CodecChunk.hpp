@@ -0,0 +1,59 @@
+#ifndef CODEC_CHUNK_HPP_
+#define CODEC_CHUNK_HPP_
+
+#include <array>
+#include <span>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+namespace ntt
+{
+    // Compressed entries are stored as a sequence of chunks:
+    // a 4 bytes signature ("ZIPX", "LZ2K"), the decompressed size, the compressed size
+    // (both little-endian 32 bits) and then the compressed bytes.
+    struct CodecChunk {
+        static constexpr std::size_t HEADER_SIZE = 0xC;
+
+        std::array<char, 4> _sign;
+        std::uint32_t _size;
+        std::uint32_t _zsize;
+        std::span<const std::byte> _data;
+
+        std::string_view sign() const noexcept { return {_sign.data(), _sign.size()}; }
+    };
+
+    inline std::uint32_t readChunkField(const std::byte *data) noexcept
+    {
+        return static_cast<std::uint32_t>(data[0]) |
+            static_cast<std::uint32_t>(data[1]) << 8 |
+            static_cast<std::uint32_t>(data[2]) << 16 |
+            static_cast<std::uint32_t>(data[3]) << 24;
+    }
+
+    // Reads the chunk starting at offset and moves offset past it.
+    inline CodecChunk readCodecChunk(std::span<const std::byte> input, std::size_t &offset)
+    {
+        if (offset > input.size() || input.size() - offset < CodecChunk::HEADER_SIZE) {
+            throw std::runtime_error("Truncated chunk header at offset " + std::to_string(offset));
+        }
+
+        CodecChunk chunk = {};
+        std::memcpy(chunk._sign.data(), input.data() + offset, chunk._sign.size());
+        chunk._size = readChunkField(input.data() + offset + 0x4);
+        chunk._zsize = readChunkField(input.data() + offset + 0x8);
+        offset += CodecChunk::HEADER_SIZE;
+
+        if (chunk._zsize > input.size() - offset) {
+            throw std::runtime_error("Chunk of " + std::to_string(chunk._zsize) + " bytes overruns the entry");
+        }
+        chunk._data = input.subspan(offset, chunk._zsize);
+        offset += chunk._zsize;
+        return chunk;
+    }
+} // namespace ntt
+
+#endif // CODEC_CHUNK_HPP_
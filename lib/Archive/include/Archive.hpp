@@ -0,0 +1,99 @@
+#ifndef ARCHIVE_HPP_
+#define ARCHIVE_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "EntryTable.hpp"
+
+namespace ntt
+{
+    class ArchiveSource;
+
+    struct ArchiveOptions {
+        bool _useIndex{true}; // Load the table from an up to date sidecar index
+        bool _writeIndex{false}; // Create or refresh the sidecar index after parsing
+        std::size_t _footerWindow{64ull << 20}; // How far from the end the table is searched, 0 means the whole archive
+    };
+
+    // Read-only access to a DAT archive for programs embedding the exporter.
+    // open() resolves the table of contents once, from its sidecar index when up to date, and only keeps
+    // a compact EntryTable and the mapping of the archive. Lookups and reads are const and thread safe.
+    // Errors are reported like the command line tool does: std::ios_base::failure when the archive cannot be read,
+    // std::out_of_range when its table is missing or inconsistent, std::runtime_error when an entry does not decode.
+    class Archive
+    {
+        public:
+            // Entries are views into the archive, valid while it is open
+            struct Entry {
+                EntryTable::Index _index;
+                std::string_view _path;
+                std::string_view _name;
+                bool _isDir;
+                std::uint32_t _dataAddr;
+                std::uint32_t _zsize;
+                std::uint32_t _size;
+
+                bool isCompressed() const noexcept { return !_isDir && _size != _zsize; }
+            };
+
+            class Iterator
+            {
+                public:
+                    using iterator_category = std::forward_iterator_tag;
+                    using value_type = Entry;
+                    using difference_type = std::ptrdiff_t;
+                    using pointer = void;
+                    using reference = Entry;
+
+                    Iterator() = default;
+                    Iterator(const Archive *archive, EntryTable::Index index) : _archive(archive), _index(index) {}
+
+                    Entry operator*() const { return (*_archive)[_index]; }
+                    Iterator &operator++() { ++_index; return *this; }
+                    Iterator operator++(int) { Iterator previous = *this; ++_index; return previous; }
+                    bool operator==(const Iterator &other) const noexcept { return _index == other._index; }
+
+                private:
+                    const Archive *_archive{nullptr};
+                    EntryTable::Index _index{0};
+            };
+
+            static std::unique_ptr<Archive> open(const std::string &path, const ArchiveOptions &options = {});
+            ~Archive();
+
+            Archive(const Archive &) = delete;
+            Archive &operator=(const Archive &) = delete;
+
+            const std::string &getPath() const noexcept { return _path; }
+            std::size_t size() const noexcept { return _entries.size(); }
+            Entry operator[](EntryTable::Index index) const;
+            Iterator begin() const { return {this, 0}; }
+            Iterator end() const { return {this, static_cast<EntryTable::Index>(_entries.size())}; }
+
+            // Looks a file up by path like the archive does, ignoring case and treating '/' and '\' alike
+            std::optional<Entry> find(std::string_view path) const;
+            // Decodes a file into output, which must be exactly entry._size bytes long
+            void read(const Entry &entry, std::span<std::byte> output) const;
+            std::vector<std::byte> read(const Entry &entry) const;
+
+            std::size_t getMemoryFootprint() const noexcept;
+
+        private:
+            std::string _path;
+            std::unique_ptr<ArchiveSource> _source;
+            EntryTable _entries;
+            std::vector<std::pair<std::uint32_t, EntryTable::Index>> _pathIndex; // (path hash, entry) of every file, sorted
+
+            Archive(std::string path, std::unique_ptr<ArchiveSource> source, EntryTable entries);
+    };
+} // namespace ntt
+
+#endif // ARCHIVE_HPP_
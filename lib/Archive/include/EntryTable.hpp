@@ -0,0 +1,51 @@
+#ifndef ENTRY_TABLE_HPP_
+#define ENTRY_TABLE_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace ntt
+{
+    // Entries of an archive as parallel arrays, with every path stored back to back in one string pool.
+    // An entry costs 21 bytes plus its path, where a parsed FilesChunk entry holds a std::string and a few dozen bytes more.
+    class EntryTable
+    {
+        public:
+            using Index = std::uint32_t;
+
+            EntryTable() { _pathOffsets.push_back(0); }
+
+            void reserve(std::size_t entryCount, std::size_t stringsSize);
+            Index add(std::string_view path, std::uint32_t nameLength, bool isDir, std::uint32_t dataAddr, std::uint32_t fileZsize, std::uint32_t fileSize);
+            // Drops the spare capacity left by the reservations
+            void shrinkToFit();
+
+            std::size_t size() const noexcept { return _dataAddrs.size(); }
+            bool empty() const noexcept { return _dataAddrs.empty(); }
+
+            std::string_view getPath(Index index) const noexcept { return std::string_view(_strings).substr(_pathOffsets[index], _pathOffsets[index + 1] - _pathOffsets[index]); }
+            std::string_view getName(Index index) const noexcept { return getPath(index).substr(getPath(index).size() - _nameLengths[index]); }
+            bool isDirectory(Index index) const noexcept { return (_flags[index] & FLAG_DIRECTORY) != 0; }
+            std::uint32_t getDataAddr(Index index) const noexcept { return _dataAddrs[index]; }
+            std::uint32_t getZsize(Index index) const noexcept { return _zsizes[index]; }
+            std::uint32_t getSize(Index index) const noexcept { return _sizes[index]; }
+
+            std::size_t getMemoryFootprint() const noexcept;
+
+        private:
+            static constexpr std::uint8_t FLAG_DIRECTORY = 0x1;
+
+            std::string _strings;
+            std::vector<std::uint32_t> _pathOffsets; // One more than there are entries, path i ends where path i + 1 starts
+            std::vector<std::uint32_t> _nameLengths; // The name is the end of the path
+            std::vector<std::uint32_t> _dataAddrs;
+            std::vector<std::uint32_t> _zsizes;
+            std::vector<std::uint32_t> _sizes;
+            std::vector<std::uint8_t> _flags;
+    };
+} // namespace ntt
+
+#endif // ENTRY_TABLE_HPP_
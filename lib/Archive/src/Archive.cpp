@@ -0,0 +1,159 @@
+#include "Archive.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include <unordered_map>
+#include "BaseHandler.hpp"
+#include "ZipX.hpp"
+#include "LZ2K.hpp"
+#include "DAT/Dat.hpp"
+#include "IO/ArchiveSource.hpp"
+#include "IO/FooterLocator.hpp"
+#include "IO/IndexFile.hpp"
+#include "Utils/PathHash.hpp"
+
+namespace ntt
+{
+    static_assert(ArchiveOptions{}._footerWindow == FooterLocator::DEFAULT_TAIL_WINDOW);
+
+    namespace
+    {
+        // Codec contexts are reused from one read to the next, one set per thread
+        BaseHandler *findHandler(std::span<const std::byte> data)
+        {
+            thread_local std::unordered_map<std::string, std::unique_ptr<BaseHandler>> handlers = []() {
+                std::unordered_map<std::string, std::unique_ptr<BaseHandler>> map;
+                map.emplace("ZIPX", std::make_unique<zipx::ZipX>());
+                map.emplace("LZ2K", std::make_unique<lz2k::LZ2K>());
+                return map;
+            }();
+
+            auto it = handlers.find(std::string(reinterpret_cast<const char *>(data.data()), 4));
+            return it == handlers.end() ? nullptr : it->second.get();
+        }
+    } // namespace
+
+    // The table is resolved by the same steps as the command line tool, then copied into the compact table
+    // and the parsed chunk is released. The archive is reopened on its own for the reads.
+    // Its progress lines are debug output here: a host holding hundreds of archives only hears about their problems.
+    std::unique_ptr<Archive> Archive::open(const std::string &path, const ArchiveOptions &options)
+    {
+        EntryTable entries;
+        std::size_t archiveSize = 0ull;
+        std::int64_t modificationTime = 0;
+        {
+            Dat dat(path, spdlog::level::debug);
+            const std::string indexPath = IndexFile::pathFor(path);
+            if (!options._useIndex || !dat.loadIndex(indexPath)) {
+                const std::ptrdiff_t offset = dat.getFilesChunkOffset(".CC40TAD", options._footerWindow);
+                if (offset < 0) {
+                    throw std::out_of_range("No .CC40TAD chunk found at the end of " + path);
+                }
+                dat.setFilesChunkHeader(offset);
+                dat.parseFilesChunk();
+                dat.getFilesOffset();
+                dat.setCRCdatabase();
+                dat.computeCRC();
+                if (options._writeIndex) {
+                    dat.saveIndex(indexPath);
+                }
+            }
+
+            std::size_t stringsSize = 0ull;
+            dat.forEachEntry([&stringsSize](const FilesChunk::EntryView &entry) { stringsSize += entry._pathName.size(); });
+            entries.reserve(dat.getEntryCount(), stringsSize);
+            dat.forEachEntry([&entries](const FilesChunk::EntryView &entry) {
+                entries.add(entry._pathName, entry._nameLength, entry._isDir, entry._dataAddr, entry._fileZsize, entry._fileSize);
+            });
+            archiveSize = dat.getSource().getSize();
+            modificationTime = dat.getSource().getModificationTime();
+        }
+
+        auto source = std::make_unique<ArchiveSource>(path);
+        if (source->getSize() != archiveSize || source->getModificationTime() != modificationTime) {
+            throw std::ios_base::failure("Archive changed while being opened: " + path);
+        }
+        return std::unique_ptr<Archive>(new Archive(path, std::move(source), std::move(entries)));
+    }
+
+    Archive::Archive(std::string path, std::unique_ptr<ArchiveSource> source, EntryTable entries)
+        : _path(std::move(path)), _source(std::move(source)), _entries(std::move(entries))
+    {
+        std::vector<EntryTable::Index> files;
+        std::vector<std::string_view> paths;
+        for (EntryTable::Index index = 0; index < _entries.size(); ++index) {
+            if (!_entries.isDirectory(index)) {
+                files.push_back(index);
+                paths.push_back(_entries.getPath(index));
+            }
+        }
+        std::vector<std::uint32_t> hashes(paths.size());
+        utils::pathHashBatch(paths, hashes);
+
+        _pathIndex.reserve(files.size());
+        for (std::size_t file = 0ull; file < files.size(); ++file) {
+            _pathIndex.emplace_back(hashes[file], files[file]);
+        }
+        std::sort(_pathIndex.begin(), _pathIndex.end());
+        _entries.shrinkToFit();
+    }
+
+    Archive::~Archive()
+    {
+    }
+
+    Archive::Entry Archive::operator[](EntryTable::Index index) const
+    {
+        if (index >= _entries.size()) {
+            throw std::out_of_range("Entry " + std::to_string(index) + " is out of bounds in " + _path);
+        }
+        return {index, _entries.getPath(index), _entries.getName(index), _entries.isDirectory(index), _entries.getDataAddr(index), _entries.getZsize(index), _entries.getSize(index)};
+    }
+
+    std::optional<Archive::Entry> Archive::find(std::string_view path) const
+    {
+        const std::uint32_t hash = utils::pathHash(path);
+        for (auto it = std::lower_bound(_pathIndex.begin(), _pathIndex.end(), std::make_pair(hash, EntryTable::Index{0})); it != _pathIndex.end() && it->first == hash; ++it) {
+            if (utils::pathEquals(_entries.getPath(it->second), path)) {
+                return (*this)[it->second];
+            }
+        }
+        return std::nullopt;
+    }
+
+    void Archive::read(const Entry &entry, std::span<std::byte> output) const
+    {
+        if (entry._isDir) {
+            throw std::out_of_range(std::string(entry._path) + " is a directory");
+        }
+        if (output.size() != entry._size) {
+            throw std::out_of_range("Reading " + std::string(entry._path) + " needs " + std::to_string(entry._size) + " bytes of output");
+        }
+
+        std::vector<std::byte> scratch; // Only used when the archive is not mapped
+        std::span<const std::byte> data = _source->read(entry._dataAddr, entry.isCompressed() ? entry._zsize : entry._size, scratch);
+        if (!entry.isCompressed()) {
+            std::copy(data.begin(), data.end(), output.begin());
+            return;
+        }
+        if (data.size() < 4ull) {
+            throw std::runtime_error(std::string(entry._path) + " has insufficient data for signature extraction");
+        }
+        BaseHandler *handler = findHandler(data);
+        if (handler == nullptr) {
+            throw std::runtime_error(std::string(entry._path) + " with signature " + std::string(reinterpret_cast<const char *>(data.data()), 4) + " is unknown");
+        }
+        handler->handle(data, output);
+    }
+
+    std::vector<std::byte> Archive::read(const Entry &entry) const
+    {
+        std::vector<std::byte> output(entry._size);
+        read(entry, output);
+        return output;
+    }
+
+    std::size_t Archive::getMemoryFootprint() const noexcept
+    {
+        return sizeof(*this) + _path.capacity() + _entries.getMemoryFootprint() + _pathIndex.capacity() * sizeof(_pathIndex[0]);
+    }
+} // namespace ntt
@@ -0,0 +1,51 @@
+#include "EntryTable.hpp"
+#include <limits>
+#include <stdexcept>
+
+namespace ntt
+{
+    void EntryTable::reserve(std::size_t entryCount, std::size_t stringsSize)
+    {
+        _strings.reserve(stringsSize);
+        _pathOffsets.reserve(entryCount + 1);
+        _nameLengths.reserve(entryCount);
+        _dataAddrs.reserve(entryCount);
+        _zsizes.reserve(entryCount);
+        _sizes.reserve(entryCount);
+        _flags.reserve(entryCount);
+    }
+
+    EntryTable::Index EntryTable::add(std::string_view path, std::uint32_t nameLength, bool isDir, std::uint32_t dataAddr, std::uint32_t fileZsize, std::uint32_t fileSize)
+    {
+        if (path.size() > std::numeric_limits<std::uint32_t>::max() - _strings.size() || nameLength > path.size()) {
+            throw std::length_error("Entry path does not fit in the table: " + std::string(path));
+        }
+
+        const Index index = static_cast<Index>(size());
+        _strings.append(path);
+        _pathOffsets.push_back(static_cast<std::uint32_t>(_strings.size()));
+        _nameLengths.push_back(nameLength);
+        _dataAddrs.push_back(dataAddr);
+        _zsizes.push_back(fileZsize);
+        _sizes.push_back(fileSize);
+        _flags.push_back(isDir ? FLAG_DIRECTORY : 0);
+        return index;
+    }
+
+    void EntryTable::shrinkToFit()
+    {
+        _strings.shrink_to_fit();
+        _pathOffsets.shrink_to_fit();
+        _nameLengths.shrink_to_fit();
+        _dataAddrs.shrink_to_fit();
+        _zsizes.shrink_to_fit();
+        _sizes.shrink_to_fit();
+        _flags.shrink_to_fit();
+    }
+
+    std::size_t EntryTable::getMemoryFootprint() const noexcept
+    {
+        return _strings.capacity() + (_pathOffsets.capacity() + _nameLengths.capacity() + _dataAddrs.capacity() + _zsizes.capacity() + _sizes.capacity()) * sizeof(std::uint32_t) +
+            _flags.capacity();
+    }
+} // namespace ntt
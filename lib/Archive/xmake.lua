@@ -0,0 +1,20 @@
+add_rules("mode.debug", "mode.release")
+
+set_languages("c++20")
+set_policy("build.warning", true)
+set_warnings("all", "error")
+add_cxxflags("-Wall", "-O2")
+
+-- Embeddable archive reader, static by default: xmake f -k shared for a shared library
+target("Archive")
+    set_kind("$(kind)")
+    set_basename("NTTArchive")
+    add_includedirs("include", {public = true})
+    add_includedirs("$(projectdir)/include", "$(projectdir)/src")
+    add_files("src/*.cpp")
+    add_deps("ZipX", "LZ2K")
+    add_packages("spdlog")
+    if is_plat("linux") then
+        add_syslinks("pthread")
+    end
+    add_rules("utils.symbols.export_all", {export_classes = true})
@@ -0,0 +1,92 @@
+// Single core LZ2K throughput, compared against zlib inflate on the same decoded data.
+// Usage: LZ2KBench <entry.lz2k>... [-n iterations]
+// Each input is a raw LZ2K entry as stored in a DAT archive (chunk headers included).
+
+#include "LZ2K.hpp"
+#include "CodecChunk.hpp"
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <zlib.h>
+#include <spdlog/spdlog.h>
+
+namespace
+{
+    std::vector<std::byte> readWholeFile(const std::string &path)
+    {
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        if (!file) {
+            throw std::ios_base::failure("Failed to open file: " + path);
+        }
+        std::vector<std::byte> buffer(static_cast<std::size_t>(file.tellg()));
+        file.seekg(0, std::ios::beg);
+        file.read(reinterpret_cast<char *>(buffer.data()), buffer.size());
+        return buffer;
+    }
+
+    std::size_t decodedSize(std::span<const std::byte> entry)
+    {
+        std::size_t offset = 0ull;
+        std::size_t size = 0ull;
+        while (offset < entry.size()) {
+            size += ntt::readCodecChunk(entry, offset)._size;
+        }
+        return size;
+    }
+
+    template <typename Function>
+    double measureMBps(std::size_t bytesPerRun, int iterations, Function &&run)
+    {
+        run(); // Warm up caches and tables
+        const auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; ++i) {
+            run();
+        }
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        return static_cast<double>(bytesPerRun) * iterations / elapsed.count() / (1024.0 * 1024.0);
+    }
+}
+
+int main(int argc, const char *argv[])
+{
+    std::vector<std::string> inputs;
+    int iterations = 20;
+
+    for (int argIndex = 1; argIndex < argc; ++argIndex) {
+        std::string arg = argv[argIndex];
+        if (arg == "-n" && argIndex + 1 < argc) {
+            iterations = std::stoi(argv[++argIndex]);
+        } else {
+            inputs.push_back(arg);
+        }
+    }
+    if (inputs.empty()) {
+        spdlog::error("Usage: LZ2KBench <entry.lz2k>... [-n iterations]");
+        return 1;
+    }
+
+    lz2k::LZ2K decoder;
+    for (const std::string &input : inputs) {
+        try {
+            const std::vector<std::byte> entry = readWholeFile(input);
+            std::vector<std::byte> output(decodedSize(entry));
+            const double lz2kSpeed = measureMBps(output.size(), iterations, [&]() { decoder.handle(entry, output); });
+
+            uLongf zsize = compressBound(static_cast<uLong>(output.size()));
+            std::vector<Bytef> zdata(zsize);
+            compress2(zdata.data(), &zsize, reinterpret_cast<const Bytef *>(output.data()), static_cast<uLong>(output.size()), Z_DEFAULT_COMPRESSION);
+            std::vector<Bytef> inflated(output.size());
+            const double zlibSpeed = measureMBps(output.size(), iterations, [&]() {
+                uLongf size = static_cast<uLongf>(inflated.size());
+                uncompress(inflated.data(), &size, zdata.data(), zsize);
+            });
+
+            spdlog::info("{}: {} -> {} bytes, LZ2K {:.1f} MB/s, zlib inflate {:.1f} MB/s ({} -> {} bytes), ratio {:.2f}",
+                input, entry.size(), output.size(), lz2kSpeed, zlibSpeed, zsize, output.size(), lz2kSpeed / zlibSpeed);
+        } catch (const std::exception &e) {
+            spdlog::error("{}: {}", input, e.what());
+        }
+    }
+    return 0;
+}
@@ -1,23 +1,75 @@
 #ifndef LZ2K_HPP_
 #define LZ2K_HPP_
 
+#include <span>
+#include <array>
 #include <vector>
 #include <cstddef>
+#include <cstdint>
 #include "BaseHandler.hpp"
 
 namespace lz2k
 {
+    // LZ2K is the LHA -lh5- scheme (LZ77 over an 8 KB window, with the literal/length,
+    // distance and code length alphabets Huffman coded per block) used by TT Games.
     class LZ2K : public ntt::BaseHandler
     {
         public:
-            explicit LZ2K(const std::vector<std::byte> &buffer);
+            LZ2K() = default;
             ~LZ2K() = default;
 
-            void handle() const override;
+            void handle(std::span<const std::byte> input, std::span<std::byte> output) override;
+            void handleStream(std::span<const std::byte> input, std::size_t outputSize, const Sink &sink) override;
 
         private:
-            const std::vector<std::byte> &_compressedBuffer;
+            static constexpr unsigned DICBIT = 13;
+            static constexpr unsigned MAXMATCH = 256;
+            static constexpr unsigned THRESHOLD = 3;
+            static constexpr unsigned NC = 0xFF + MAXMATCH + 2 - THRESHOLD; // Literals and match lengths
+            static constexpr unsigned NP = DICBIT + 1; // Distance bit lengths
+            static constexpr unsigned NT = 16 + 3; // Code lengths
+            static constexpr unsigned NPT = NT;
+            static constexpr unsigned CBIT = 9;
+            static constexpr unsigned PBIT = 4;
+            static constexpr unsigned TBIT = 5;
+            static constexpr unsigned CTABLEBITS = 12;
+            static constexpr unsigned PTTABLEBITS = 8;
+            static constexpr std::size_t DICSIZ = 1ull << DICBIT; // Farthest a match can reach back
+
+            // Bit reader, MSB first. _bitBuf holds _bitCount valid bits at its top.
+            const std::uint8_t *_in{nullptr};
+            const std::uint8_t *_inEnd{nullptr};
+            std::uint64_t _bitBuf{0};
+            unsigned _bitCount{0};
+            unsigned _overrun{0};
+
+            // Decoding tables: entries pack a symbol (or a tree node for long codes) with its code length.
+            std::uint16_t _blockSize{0};
+            std::array<std::uint8_t, NC> _cLen{};
+            std::array<std::uint8_t, NPT> _ptLen{};
+            std::array<std::uint16_t, 1u << CTABLEBITS> _cTable{};
+            std::array<std::uint16_t, 1u << PTTABLEBITS> _ptTable{};
+            std::array<std::uint16_t, 2 * NC> _left{};
+            std::array<std::uint16_t, 2 * NC> _right{};
+
+            // Streaming output: the last DICSIZ bytes already handed out, followed by the window being decoded
+            std::vector<std::byte> _window;
+
+            void _beginChunk(std::span<const std::byte> input) noexcept;
+            std::byte *_decodeSymbols(const std::byte *outBegin, std::byte *out, std::byte *outEnd, const std::byte *outStop);
+
+            void _refill() noexcept;
+            void _refillSlow();
+            std::uint32_t _peekBits(unsigned n) const noexcept { return n == 0 ? 0u : static_cast<std::uint32_t>(_bitBuf >> (64 - n)); }
+            void _dropBits(unsigned n) noexcept { _bitBuf <<= n; _bitCount -= n; }
+            std::uint32_t _getBits(unsigned n);
+
+            void _readBlockHeader();
+            void _readPtLen(unsigned nn, unsigned nbit, int iSpecial);
+            void _readCLen();
+            void _makeTable(unsigned nchar, const std::uint8_t *bitLen, unsigned tableBits, std::uint16_t *table);
+            unsigned _decodeSymbol(const std::uint16_t *table, unsigned tableBits, const std::uint8_t *bitLen, unsigned nchar) noexcept;
     };
-} // namespace zipx
+} // namespace lz2k
 
 #endif // LZ2K_HPP_
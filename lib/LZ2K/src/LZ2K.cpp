@@ -1,16 +1,385 @@
 #include "LZ2K.hpp"
-#include <spdlog/spdlog.h>
+#include "CodecChunk.hpp"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
 
 namespace lz2k
 {
-    LZ2K::LZ2K(const std::vector<std::byte> &buffer)
-        : _compressedBuffer(buffer)
+    namespace
     {
+        constexpr std::uint16_t UNUSED_NODE = 0xFFFF;
+        constexpr unsigned SYMBOL_MASK = 0x7FF;
+        constexpr unsigned LENGTH_SHIFT = 11;
+
+        inline std::uint64_t loadBigEndian64(const std::uint8_t *data) noexcept
+        {
+            // Compilers turn this into a single load + bswap
+            return static_cast<std::uint64_t>(data[0]) << 56 | static_cast<std::uint64_t>(data[1]) << 48 |
+                static_cast<std::uint64_t>(data[2]) << 40 | static_cast<std::uint64_t>(data[3]) << 32 |
+                static_cast<std::uint64_t>(data[4]) << 24 | static_cast<std::uint64_t>(data[5]) << 16 |
+                static_cast<std::uint64_t>(data[6]) << 8 | static_cast<std::uint64_t>(data[7]);
+        }
+    }
+
+    void LZ2K::handle(std::span<const std::byte> input, std::span<std::byte> output)
+    {
+        std::byte *out = output.data();
+        std::byte *outEnd = output.data() + output.size();
+        std::size_t offset = 0ull;
+
+        while (out < outEnd) {
+            ntt::CodecChunk chunk = ntt::readCodecChunk(input, offset);
+            if (chunk.sign() != "LZ2K") {
+                throw std::runtime_error("Unexpected chunk signature " + std::string(chunk.sign()) + " in a LZ2K entry");
+            }
+            if (chunk._size > static_cast<std::size_t>(outEnd - out)) {
+                throw std::runtime_error("LZ2K chunk of " + std::to_string(chunk._size) + " bytes overflows the entry");
+            }
+
+            if (chunk._size == chunk._zsize) { // Stored chunk
+                std::memcpy(out, chunk._data.data(), chunk._size);
+            } else {
+                _beginChunk(chunk._data);
+                _decodeSymbols(output.data(), out, out + chunk._size, out + chunk._size);
+            }
+            out += chunk._size;
+        }
+    }
+
+    // Decodes into _window and flushes it whenever it fills up, keeping the last DICSIZ bytes
+    // at its start so that matches can still reach back into output that was already handed out.
+    void LZ2K::handleStream(std::span<const std::byte> input, std::size_t outputSize, const Sink &sink)
+    {
+        _window.resize(DICSIZ + STREAM_WINDOW + MAXMATCH);
+        std::byte *const begin = _window.data();
+        std::byte *const end = begin + _window.size();
+        std::byte *out = begin;
+        std::byte *flushed = begin; // Start of the output not handed out yet
+        std::size_t produced = 0ull;
+        std::size_t offset = 0ull;
+
+        auto flush = [&]() {
+            for (; flushed != out; flushed += std::min<std::size_t>(STREAM_WINDOW, out - flushed)) {
+                sink(std::span<const std::byte>(flushed, std::min<std::size_t>(STREAM_WINDOW, out - flushed)));
+            }
+            const std::size_t keep = std::min<std::size_t>(DICSIZ, out - begin);
+            std::memmove(begin, out - keep, keep);
+            out = begin + keep;
+            flushed = out;
+        };
+
+        while (produced < outputSize) {
+            ntt::CodecChunk chunk = ntt::readCodecChunk(input, offset);
+            if (chunk.sign() != "LZ2K") {
+                throw std::runtime_error("Unexpected chunk signature " + std::string(chunk.sign()) + " in a LZ2K entry");
+            }
+            if (chunk._size > outputSize - produced) {
+                throw std::runtime_error("LZ2K chunk of " + std::to_string(chunk._size) + " bytes overflows the entry");
+            }
+
+            if (chunk._size == chunk._zsize) { // Stored chunk: handed out as is, only its tail is kept as history
+                flush();
+                for (std::size_t done = 0ull; done < chunk._size; done += STREAM_WINDOW) {
+                    sink(chunk._data.subspan(done, std::min(STREAM_WINDOW, chunk._size - done)));
+                }
+                const std::size_t keep = std::min<std::size_t>(DICSIZ, chunk._size);
+                if (keep == DICSIZ) {
+                    out = begin;
+                }
+                std::memcpy(out, chunk._data.data() + chunk._size - keep, keep);
+                out += keep;
+                flushed = out;
+            } else {
+                _beginChunk(chunk._data);
+                std::size_t remaining = chunk._size;
+                while (remaining != 0) {
+                    if (static_cast<std::size_t>(end - out) <= MAXMATCH) {
+                        flush();
+                    }
+                    // Away from the end of the chunk, stop early enough for the longest match to still fit
+                    const std::size_t room = end - out;
+                    std::byte *const stop = remaining <= room ? out + remaining : end - MAXMATCH;
+                    std::byte *const next = _decodeSymbols(begin, out, remaining <= room ? out + remaining : end, stop);
+                    remaining -= next - out;
+                    out = next;
+                }
+            }
+            produced += chunk._size;
+        }
+        flush();
+    }
+
+    void LZ2K::_beginChunk(std::span<const std::byte> input) noexcept
+    {
+        _in = reinterpret_cast<const std::uint8_t *>(input.data());
+        _inEnd = _in + input.size();
+        _bitBuf = 0ull;
+        _bitCount = 0u;
+        _overrun = 0u;
+        _blockSize = 0u;
+    }
+
+    // Decodes symbols until out reaches outStop. Matches may run past outStop but never past outEnd,
+    // and may reach back as far as outBegin. Returns where the output stopped.
+    std::byte *LZ2K::_decodeSymbols(const std::byte *outBegin, std::byte *out, std::byte *outEnd, const std::byte *outStop)
+    {
+        while (out < outStop) {
+            if (_blockSize == 0u) {
+                _readBlockHeader();
+            }
+            _blockSize -= 1u;
+
+            // 57 bits cover the longest symbol: a 16 bits length code, a 16 bits distance code and 12 extra bits.
+            _refill();
+            const unsigned c = _decodeSymbol(_cTable.data(), CTABLEBITS, _cLen.data(), NC);
+            if (c <= 0xFF) {
+                *out++ = static_cast<std::byte>(c);
+                continue;
+            }
+
+            const std::size_t length = c - (0xFF + 1 - THRESHOLD);
+            std::size_t distance = _decodeSymbol(_ptTable.data(), PTTABLEBITS, _ptLen.data(), NP);
+            if (distance != 0u) {
+                distance = (1u << (distance - 1)) + _getBits(static_cast<unsigned>(distance - 1));
+            }
+            distance += 1u;
+
+            if (distance > static_cast<std::size_t>(out - outBegin)) {
+                throw std::runtime_error("LZ2K match distance " + std::to_string(distance) + " points before the start of the entry");
+            }
+            if (length > static_cast<std::size_t>(outEnd - out)) {
+                throw std::runtime_error("LZ2K match of " + std::to_string(length) + " bytes overflows the chunk");
+            }
+
+            const std::byte *src = out - distance;
+            if (distance >= 8u && static_cast<std::size_t>(outEnd - out) >= length + 8u) {
+                // Source and destination never overlap within one 8 bytes step, so copying
+                // a few bytes too many is harmless: they are overwritten by what comes next.
+                std::byte *dst = out;
+                std::byte *stop = out + length;
+                do {
+                    std::memcpy(dst, src, 8);
+                    dst += 8;
+                    src += 8;
+                } while (dst < stop);
+            } else {
+                for (std::size_t i = 0ull; i < length; ++i) {
+                    out[i] = src[i];
+                }
+            }
+            out += length;
+        }
+        return out;
+    }
+
+    void LZ2K::_refill() noexcept
+    {
+        if (_bitCount > 56u) {
+            return;
+        }
+        if (_inEnd - _in < 8) {
+            _refillSlow();
+            return;
+        }
+        // Branchless refill: load 8 bytes, keep the whole ones that fit. The partial byte
+        // below _bitCount is loaded again by the next refill with the same value.
+        _bitBuf |= loadBigEndian64(_in) >> _bitCount;
+        const unsigned bytes = (63u - _bitCount) >> 3;
+        _in += bytes;
+        _bitCount += bytes << 3;
+    }
+
+    void LZ2K::_refillSlow()
+    {
+        while (_bitCount <= 56u) {
+            std::uint64_t byte = 0ull;
+            if (_in < _inEnd) {
+                byte = *_in++;
+            } else if (++_overrun > 8u) {
+                // Zero padding is only ever peeked at, consuming it means the stream is truncated
+                throw std::runtime_error("Truncated LZ2K stream");
+            }
+            _bitBuf |= byte << (56u - _bitCount);
+            _bitCount += 8u;
+        }
     }
 
-    void LZ2K::handle() const
+    std::uint32_t LZ2K::_getBits(unsigned n)
     {
-        spdlog::info("Handling a LZ2K file with size: {}", _compressedBuffer.size());
+        if (_bitCount < n) {
+            _refill();
+        }
+        const std::uint32_t value = _peekBits(n);
+        _dropBits(n);
+        return value;
+    }
+
+    void LZ2K::_readBlockHeader()
+    {
+        _blockSize = static_cast<std::uint16_t>(_getBits(16));
+        _readPtLen(NT, TBIT, 3);
+        _readCLen();
+        _readPtLen(NP, PBIT, -1);
+    }
+
+    void LZ2K::_readPtLen(unsigned nn, unsigned nbit, int iSpecial)
+    {
+        const unsigned n = _getBits(nbit);
+
+        if (n == 0u) {
+            const unsigned c = _getBits(nbit);
+            if (c >= nn) {
+                throw std::runtime_error("Bad LZ2K code length table");
+            }
+            std::fill(_ptLen.begin(), _ptLen.begin() + nn, 0u);
+            std::fill(_ptTable.begin(), _ptTable.end(), static_cast<std::uint16_t>(c));
+            return;
+        }
+        if (n > nn) {
+            throw std::runtime_error("Bad LZ2K code length table");
+        }
+
+        unsigned i = 0u;
+        while (i < n) {
+            _refill();
+            unsigned c = _peekBits(3);
+            if (c == 7u) {
+                // Lengths of 7 and more are written in unary after the first 3 bits
+                std::uint64_t mask = 1ull << (63 - 3);
+                while (_bitBuf & mask) {
+                    mask >>= 1;
+                    c += 1u;
+                    if (c > 16u) {
+                        throw std::runtime_error("Bad LZ2K code length");
+                    }
+                }
+            }
+            _dropBits(c < 7u ? 3u : c - 3u);
+            _ptLen[i++] = static_cast<std::uint8_t>(c);
+
+            if (static_cast<int>(i) == iSpecial) {
+                unsigned zeros = _getBits(2);
+                while (zeros-- > 0u && i < nn) {
+                    _ptLen[i++] = 0u;
+                }
+            }
+        }
+        std::fill(_ptLen.begin() + i, _ptLen.begin() + nn, 0u);
+        _makeTable(nn, _ptLen.data(), PTTABLEBITS, _ptTable.data());
+    }
+
+    void LZ2K::_readCLen()
+    {
+        const unsigned n = _getBits(CBIT);
+
+        if (n == 0u) {
+            const unsigned c = _getBits(CBIT);
+            if (c >= NC) {
+                throw std::runtime_error("Bad LZ2K literal table");
+            }
+            _cLen.fill(0u);
+            _cTable.fill(static_cast<std::uint16_t>(c));
+            return;
+        }
+        if (n > NC) {
+            throw std::runtime_error("Bad LZ2K literal table");
+        }
+
+        unsigned i = 0u;
+        while (i < n) {
+            _refill();
+            unsigned c = _decodeSymbol(_ptTable.data(), PTTABLEBITS, _ptLen.data(), NT);
+            if (c <= 2u) {
+                // Runs of unused symbols
+                if (c == 0u) {
+                    c = 1u;
+                } else if (c == 1u) {
+                    c = _getBits(4) + 3u;
+                } else {
+                    c = _getBits(CBIT) + 20u;
+                }
+                if (c > n - i) {
+                    throw std::runtime_error("Bad LZ2K literal table");
+                }
+                std::fill_n(_cLen.begin() + i, c, 0u);
+                i += c;
+            } else {
+                _cLen[i++] = static_cast<std::uint8_t>(c - 2u);
+            }
+        }
+        std::fill(_cLen.begin() + i, _cLen.end(), 0u);
+        _makeTable(NC, _cLen.data(), CTABLEBITS, _cTable.data());
+    }
+
+    // Builds the canonical Huffman decoding table: codes up to tableBits long resolve with a
+    // single lookup, longer ones continue into a binary tree stored in _left/_right.
+    void LZ2K::_makeTable(unsigned nchar, const std::uint8_t *bitLen, unsigned tableBits, std::uint16_t *table)
+    {
+        std::array<std::uint32_t, 17> count{};
+        std::array<std::uint32_t, 18> start{};
+
+        for (unsigned i = 0u; i < nchar; ++i) {
+            if (bitLen[i] > 16u) {
+                throw std::runtime_error("Bad LZ2K table");
+            }
+            count[bitLen[i]] += 1u;
+        }
+        for (unsigned len = 1u; len <= 16u; ++len) {
+            start[len + 1] = start[len] + (count[len] << (16u - len));
+        }
+        if (start[17] != (1u << 16)) {
+            throw std::runtime_error("Bad LZ2K table");
+        }
+
+        std::fill_n(table, 1u << tableBits, UNUSED_NODE);
+        unsigned nextNode = nchar;
+
+        for (unsigned ch = 0u; ch < nchar; ++ch) {
+            const unsigned len = bitLen[ch];
+            if (len == 0u) {
+                continue;
+            }
+            const std::uint32_t code = start[len];
+            start[len] += 1u << (16u - len);
+
+            if (len <= tableBits) {
+                const std::uint32_t index = code >> (16u - tableBits);
+                std::fill_n(table + index, 1u << (tableBits - len), static_cast<std::uint16_t>(ch | (len << LENGTH_SHIFT)));
+                continue;
+            }
+
+            std::uint16_t *node = &table[code >> (16u - tableBits)];
+            for (unsigned bit = 16u - tableBits; bit-- > 16u - len;) {
+                if (*node == UNUSED_NODE) {
+                    _left[nextNode] = UNUSED_NODE;
+                    _right[nextNode] = UNUSED_NODE;
+                    *node = static_cast<std::uint16_t>(nextNode++);
+                }
+                node = ((code >> bit) & 1u) ? &_right[*node] : &_left[*node];
+            }
+            *node = static_cast<std::uint16_t>(ch);
+        }
+    }
+
+    unsigned LZ2K::_decodeSymbol(const std::uint16_t *table, unsigned tableBits, const std::uint8_t *bitLen, unsigned nchar) noexcept
+    {
+        const std::uint16_t entry = table[_peekBits(tableBits)];
+        unsigned symbol = entry & SYMBOL_MASK;
+
+        if (symbol < nchar) {
+            _dropBits(entry >> LENGTH_SHIFT);
+            return symbol;
+        }
+
+        std::uint64_t mask = 1ull << (63 - tableBits);
+        do {
+            symbol = (_bitBuf & mask) ? _right[symbol] : _left[symbol];
+            mask >>= 1;
+        } while (symbol >= nchar);
+        _dropBits(bitLen[symbol]);
+        return symbol;
     }
 
-} // namespace zipx
+} // namespace lz2k
@@ -10,4 +10,11 @@ target("LZ2K")
     set_basename("LZ2Klib")
     add_includedirs("include", "$(projectdir)/include", {public = true})
     add_files("src/*.cpp")
-    add_rules("utils.symbols.export_all", {export_classes = true})
\ No newline at end of file
+    add_rules("utils.symbols.export_all", {export_classes = true})
+
+target("LZ2KBench")
+    set_kind("binary")
+    set_default(false)
+    add_files("bench/*.cpp")
+    add_deps("LZ2K")
+    add_packages("spdlog", "zlib")
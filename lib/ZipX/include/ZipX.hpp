@@ -1,23 +1,37 @@
 #ifndef ZIPX_HPP_
 #define ZIPX_HPP_
 
+#include <span>
+#include <memory>
 #include <vector>
 #include <cstddef>
 #include "BaseHandler.hpp"
-#include "zlib.h"
 
 namespace zipx
 {
+    // ZIPX chunks are deflate streams, with or without a zlib wrapper.
+    // The inflate backend (zlib, zlib-ng or libdeflate) is picked at build time, see xmake.lua.
     class ZipX : public ntt::BaseHandler
     {
         public:
-            explicit ZipX(const std::vector<std::byte> &buffer);
-            ~ZipX() = default;
+            ZipX();
+            ~ZipX();
 
-            void handle() const override;
+            ZipX(const ZipX &) = delete;
+            ZipX &operator=(const ZipX &) = delete;
+
+            void handle(std::span<const std::byte> input, std::span<std::byte> output) override;
+            void handleStream(std::span<const std::byte> input, std::size_t outputSize, const Sink &sink) override;
+
+            static const char *backendName() noexcept;
 
         private:
-            const std::vector<std::byte> &_compressedBuffer;
+            struct Backend;
+            std::unique_ptr<Backend> _backend;
+            std::vector<std::byte> _window; // Streaming output
+
+            void _inflateChunk(std::span<const std::byte> input, std::span<std::byte> output);
+            void _inflateChunkStream(std::span<const std::byte> input, std::size_t outputSize, const Sink &sink);
     };
 } // namespace zipx
 
@@ -1,16 +1,223 @@
 #include "ZipX.hpp"
-#include <spdlog/spdlog.h>
+#include "CodecChunk.hpp"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#if defined(ZIPX_USE_LIBDEFLATE)
+    #include <libdeflate.h>
+#elif defined(ZIPX_USE_ZLIB_NG)
+    #include <zlib-ng.h>
+    #define ZIPX_Z(name) zng_##name
+    using ZStream = zng_stream;
+#else
+    #define ZLIB_CONST
+    #include "zlib.h"
+    #define ZIPX_Z(name) name
+    using ZStream = z_stream;
+#endif
 
 namespace zipx
 {
-    ZipX::ZipX(const std::vector<std::byte> &buffer)
-        : _compressedBuffer(buffer)
+    namespace
+    {
+        // A zlib wrapper starts with a CMF byte announcing deflate and a FCHECK making CMF/FLG a multiple of 31
+        bool hasZlibHeader(std::span<const std::byte> input) noexcept
+        {
+            if (input.size() < 2) {
+                return false;
+            }
+            const unsigned cmf = std::to_integer<unsigned>(input[0]);
+            const unsigned flg = std::to_integer<unsigned>(input[1]);
+            return (cmf & 0x0F) == 8 && (cmf >> 4) <= 7 && ((cmf << 8) | flg) % 31 == 0;
+        }
+    }
+
+#if defined(ZIPX_USE_LIBDEFLATE)
+    struct ZipX::Backend {
+        libdeflate_decompressor *_decompressor{nullptr};
+    };
+
+    ZipX::ZipX()
+        : _backend(std::make_unique<Backend>())
+    {
+        _backend->_decompressor = libdeflate_alloc_decompressor();
+        if (_backend->_decompressor == nullptr) {
+            throw std::runtime_error("Could not allocate a libdeflate decompressor");
+        }
+    }
+
+    ZipX::~ZipX()
+    {
+        libdeflate_free_decompressor(_backend->_decompressor);
+    }
+
+    const char *ZipX::backendName() noexcept
+    {
+        return "libdeflate";
+    }
+
+    void ZipX::_inflateChunk(std::span<const std::byte> input, std::span<std::byte> output)
+    {
+        std::size_t written = 0ull;
+        libdeflate_result result = hasZlibHeader(input)
+            ? libdeflate_zlib_decompress(_backend->_decompressor, input.data(), input.size(), output.data(), output.size(), &written)
+            : libdeflate_deflate_decompress(_backend->_decompressor, input.data(), input.size(), output.data(), output.size(), &written);
+
+        if (result != LIBDEFLATE_SUCCESS || written != output.size()) {
+            throw std::runtime_error("ZIPX chunk inflated to " + std::to_string(written) + " bytes instead of " + std::to_string(output.size()) + " (libdeflate error " + std::to_string(result) + ")");
+        }
+    }
+
+    // libdeflate only inflates whole buffers: memory is bounded by the chunk size rather than the window
+    void ZipX::_inflateChunkStream(std::span<const std::byte> input, std::size_t outputSize, const Sink &sink)
+    {
+        _window.resize(outputSize);
+        _inflateChunk(input, _window);
+        for (std::size_t offset = 0ull; offset < outputSize; offset += STREAM_WINDOW) {
+            sink(std::span<const std::byte>(_window).subspan(offset, std::min(STREAM_WINDOW, outputSize - offset)));
+        }
+    }
+#else
+    struct ZipX::Backend {
+        ZStream _stream{};
+        int _windowBits{15};
+    };
+
+    ZipX::ZipX()
+        : _backend(std::make_unique<Backend>())
+    {
+        if (ZIPX_Z(inflateInit2)(&_backend->_stream, _backend->_windowBits) != Z_OK) {
+            throw std::runtime_error("Could not initialize the inflate stream");
+        }
+    }
+
+    ZipX::~ZipX()
     {
+        ZIPX_Z(inflateEnd)(&_backend->_stream);
     }
 
-    void ZipX::handle() const
+    const char *ZipX::backendName() noexcept
     {
-        spdlog::info("Handling a ZIPX file with size: {}", _compressedBuffer.size());
+#if defined(ZIPX_USE_ZLIB_NG)
+        return "zlib-ng";
+#else
+        return "zlib";
+#endif
+    }
+
+    // Reuses the inflate state, only switching between zlib and raw deflate when the chunk needs it
+    static void resetStream(ZStream &stream, int &currentWindowBits, std::span<const std::byte> input)
+    {
+        const int windowBits = hasZlibHeader(input) ? 15 : -15;
+        const int resetResult = windowBits == currentWindowBits
+            ? ZIPX_Z(inflateReset)(&stream)
+            : ZIPX_Z(inflateReset2)(&stream, windowBits);
+        if (resetResult != Z_OK) {
+            throw std::runtime_error("Could not reset the inflate stream");
+        }
+        currentWindowBits = windowBits;
+    }
+
+    void ZipX::_inflateChunk(std::span<const std::byte> input, std::span<std::byte> output)
+    {
+        ZStream &stream = _backend->_stream;
+        resetStream(stream, _backend->_windowBits, input);
+
+        // avail_in/avail_out are 32 bits, chunk sizes are too
+        stream.next_in = reinterpret_cast<const unsigned char *>(input.data());
+        stream.avail_in = static_cast<std::uint32_t>(input.size());
+        stream.next_out = reinterpret_cast<unsigned char *>(output.data());
+        stream.avail_out = static_cast<std::uint32_t>(output.size());
+
+        const int result = ZIPX_Z(inflate)(&stream, Z_FINISH);
+        if (result != Z_STREAM_END || stream.avail_out != 0) {
+            const std::size_t written = output.size() - stream.avail_out;
+            throw std::runtime_error("ZIPX chunk inflated to " + std::to_string(written) + " bytes instead of " + std::to_string(output.size()) +
+                (stream.msg != nullptr ? std::string(" (") + stream.msg + ")" : std::string()));
+        }
+    }
+
+    void ZipX::_inflateChunkStream(std::span<const std::byte> input, std::size_t outputSize, const Sink &sink)
+    {
+        ZStream &stream = _backend->_stream;
+        resetStream(stream, _backend->_windowBits, input);
+        _window.resize(std::min(STREAM_WINDOW, outputSize));
+
+        stream.next_in = reinterpret_cast<const unsigned char *>(input.data());
+        stream.avail_in = static_cast<std::uint32_t>(input.size());
+        std::size_t written = 0ull;
+        int result = Z_OK;
+        while (written < outputSize) {
+            const std::size_t windowSize = std::min(_window.size(), outputSize - written);
+            stream.next_out = reinterpret_cast<unsigned char *>(_window.data());
+            stream.avail_out = static_cast<std::uint32_t>(windowSize);
+
+            result = ZIPX_Z(inflate)(&stream, Z_NO_FLUSH);
+            const std::size_t produced = windowSize - stream.avail_out;
+            if (produced != 0) {
+                sink(std::span<const std::byte>(_window.data(), produced));
+                written += produced;
+            }
+            if (result == Z_STREAM_END || (result != Z_OK && result != Z_BUF_ERROR) || produced == 0) {
+                break;
+            }
+        }
+        if (result != Z_STREAM_END || written != outputSize) {
+            throw std::runtime_error("ZIPX chunk inflated to " + std::to_string(written) + " bytes instead of " + std::to_string(outputSize) +
+                (stream.msg != nullptr ? std::string(" (") + stream.msg + ")" : std::string()));
+        }
+    }
+#endif
+
+    void ZipX::handle(std::span<const std::byte> input, std::span<std::byte> output)
+    {
+        std::size_t outOffset = 0ull;
+        std::size_t offset = 0ull;
+
+        while (outOffset < output.size()) {
+            ntt::CodecChunk chunk = ntt::readCodecChunk(input, offset);
+            if (chunk.sign() != "ZIPX") {
+                throw std::runtime_error("Unexpected chunk signature " + std::string(chunk.sign()) + " in a ZIPX entry");
+            }
+            if (chunk._size > output.size() - outOffset) {
+                throw std::runtime_error("ZIPX chunk of " + std::to_string(chunk._size) + " bytes overflows the entry");
+            }
+
+            std::span<std::byte> chunkOutput = output.subspan(outOffset, chunk._size);
+            if (chunk._size == chunk._zsize) { // Stored chunk
+                std::memcpy(chunkOutput.data(), chunk._data.data(), chunk._size);
+            } else {
+                _inflateChunk(chunk._data, chunkOutput);
+            }
+            outOffset += chunk._size;
+        }
+    }
+
+    void ZipX::handleStream(std::span<const std::byte> input, std::size_t outputSize, const Sink &sink)
+    {
+        std::size_t produced = 0ull;
+        std::size_t offset = 0ull;
+
+        while (produced < outputSize) {
+            ntt::CodecChunk chunk = ntt::readCodecChunk(input, offset);
+            if (chunk.sign() != "ZIPX") {
+                throw std::runtime_error("Unexpected chunk signature " + std::string(chunk.sign()) + " in a ZIPX entry");
+            }
+            if (chunk._size > outputSize - produced) {
+                throw std::runtime_error("ZIPX chunk of " + std::to_string(chunk._size) + " bytes overflows the entry");
+            }
+
+            if (chunk._size == chunk._zsize) { // Stored chunk
+                for (std::size_t done = 0ull; done < chunk._size; done += STREAM_WINDOW) {
+                    sink(chunk._data.subspan(done, std::min<std::size_t>(STREAM_WINDOW, chunk._size - done)));
+                }
+            } else {
+                _inflateChunkStream(chunk._data, chunk._size, sink);
+            }
+            produced += chunk._size;
+        }
     }
 
 } // namespace zipx
@@ -5,12 +5,34 @@ set_policy("build.warning", true)
 set_warnings("all", "error")
 add_cxxflags("-Wall", "-O2")
 
+-- Inflate backend: xmake f --zipx_backend=libdeflate
+option("zipx_backend")
+    set_default("zlib")
+    set_showmenu(true)
+    set_values("zlib", "zlib-ng", "libdeflate")
+    set_description("Inflate implementation used by ZipX")
+option_end()
+
 add_requires("zlib")
+if is_config("zipx_backend", "zlib-ng") then
+    add_requires("zlib-ng", {configs = {zlib_compat = false}})
+elseif is_config("zipx_backend", "libdeflate") then
+    add_requires("libdeflate")
+end
 
 target("ZipX")
     set_kind("shared")
     set_basename("ZipXlib")
     add_includedirs("include", "$(projectdir)/include", {public = true})
     add_files("src/*.cpp")
-    add_packages("zlib")
-    add_rules("utils.symbols.export_all", {export_classes = true})
\ No newline at end of file
+    add_options("zipx_backend")
+    if is_config("zipx_backend", "zlib-ng") then
+        add_packages("zlib-ng")
+        add_defines("ZIPX_USE_ZLIB_NG")
+    elseif is_config("zipx_backend", "libdeflate") then
+        add_packages("libdeflate")
+        add_defines("ZIPX_USE_LIBDEFLATE")
+    else
+        add_packages("zlib")
+    end
+    add_rules("utils.symbols.export_all", {export_classes = true})
@@ -0,0 +1,178 @@
+#ifndef OPTIONS_HPP
+#define OPTIONS_HPP
+
+#include <charconv>
+#include <cstddef>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "Utils/ThreadPool.hpp"
+#include "Utils/MemoryBudget.hpp"
+#include "Utils/PathFilter.hpp"
+#include "IO/FooterLocator.hpp"
+#include "IO/DirectoryOutput.hpp"
+#include "spdlog/spdlog.h"
+
+namespace cli
+{
+    struct Options {
+        std::vector<std::string> _inputFiles;
+        std::string _command; // "diff" or "pack", empty when extracting or listing
+        std::vector<std::string> _commandArgs; // Paths given to the command: old and new archive, or directory and archive
+        std::size_t _jobs{utils::ThreadPool::defaultThreadCount()};
+        std::size_t _maxMemory{0}; // 0 means unlimited
+        std::size_t _writers{ntt::DirectoryOutput::DEFAULT_WRITERS};
+        bool _list{false}; // Print the table of contents instead of extracting
+        bool _verify{false}; // Check the table and decode every entry instead of extracting
+        utils::PathFilter _filter; // --include / --exclude globs
+        std::size_t _footerWindow{ntt::FooterLocator::DEFAULT_TAIL_WINDOW}; // How far from the end the table of contents is searched, 0 means the whole archive
+        std::string _statsPath; // Where the --stats JSON report goes, "-" for stdout, empty for none
+        spdlog::level::level_enum _logLevel{spdlog::level::info};
+        bool _readIndex{true}; // Use the sidecar index of an archive when it is up to date
+        bool _writeIndex{false}; // Create or refresh sidecar indexes
+        int _level{6}; // zlib level of the pack command
+        bool _incremental{false}; // Only rewrite the entries that changed since the last extraction, remove the ones that are gone
+        std::string _format{"dir"}; // "dir" extracts into ./Content, "tar" into a single ./Content.tar
+        bool _stdout{false}; // The tar archive goes to the standard output, and the log to the standard error
+        std::string _dedup; // "link" or "clone" writes files repeating earlier content as hardlinks or reflinks, empty writes them all
+    };
+
+    // Lists one archive path per line, blank lines and lines starting with '#' are ignored
+    inline void readManifest(const std::string &manifestPath, std::vector<std::string> &inputFiles)
+    {
+        std::ifstream manifest(manifestPath);
+        if (!manifest) {
+            throw std::invalid_argument("Failed to open manifest: " + manifestPath);
+        }
+
+        std::string line;
+        while (std::getline(manifest, line)) {
+            const std::size_t begin = line.find_first_not_of(" \t\r");
+            if (begin == std::string::npos || line[begin] == '#') {
+                continue;
+            }
+            const std::size_t end = line.find_last_not_of(" \t\r");
+            inputFiles.push_back(line.substr(begin, end - begin + 1));
+        }
+    }
+
+    // The whole of text as a number, anything else is reported against the option it was given to
+    template <typename Number>
+    Number parseNumber(const std::string &option, const std::string &text)
+    {
+        Number value{};
+        const auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+        if (error != std::errc() || end != text.data() + text.size()) {
+            throw std::invalid_argument("Invalid value for " + option);
+        }
+        return value;
+    }
+
+    inline Options parseOptions(int argc, const char *argv[])
+    {
+        Options options;
+
+        for (int argIndex = 1; argIndex < argc; ++argIndex) {
+            const std::string arg = argv[argIndex];
+            auto nextValue = [&]() -> std::string {
+                if (argIndex + 1 >= argc) {
+                    throw std::invalid_argument(arg + " expects a value.");
+                }
+                return argv[++argIndex];
+            };
+
+            try {
+                if (argIndex == 1 && (arg == "diff" || arg == "pack")) {
+                    options._command = arg;
+                } else if (arg == "--list" || arg == "-l") {
+                    options._list = true;
+                } else if (arg == "--verify") {
+                    options._verify = true;
+                } else if (arg == "--include" || arg == "-i") {
+                    options._filter.addInclude(nextValue());
+                } else if (arg == "--exclude" || arg == "-x") {
+                    options._filter.addExclude(nextValue());
+                } else if (arg == "--jobs" || arg == "-j") {
+                    options._jobs = parseNumber<std::size_t>(arg, nextValue());
+                } else if (arg == "--writers") {
+                    options._writers = parseNumber<std::size_t>(arg, nextValue());
+                } else if (arg == "--max-memory") {
+                    options._maxMemory = utils::parseByteSize(nextValue());
+                } else if (arg == "--level") {
+                    options._level = parseNumber<int>(arg, nextValue());
+                    if (options._level < 0 || options._level > 9) {
+                        throw std::invalid_argument("Invalid value for " + arg);
+                    }
+                } else if (arg == "--footer-window") {
+                    options._footerWindow = utils::parseByteSize(nextValue());
+                } else if (arg == "--stats") {
+                    options._statsPath = nextValue();
+                } else if (arg == "--log-level") {
+                    const std::string level = nextValue();
+                    options._logLevel = spdlog::level::from_str(level);
+                    if (options._logLevel == spdlog::level::off && level != "off") {
+                        throw std::invalid_argument("Unknown log level: " + level);
+                    }
+                } else if (arg == "--index-cache") {
+                    options._writeIndex = true;
+                } else if (arg == "--no-index-cache") {
+                    options._readIndex = false;
+                } else if (arg == "--format") {
+                    options._format = nextValue();
+                    if (options._format != "dir" && options._format != "tar") {
+                        throw std::invalid_argument("Unknown format: " + options._format);
+                    }
+                } else if (arg == "--dedup") {
+                    options._dedup = nextValue();
+                    if (options._dedup != "link" && options._dedup != "clone") {
+                        throw std::invalid_argument("Unknown dedup mode: " + options._dedup);
+                    }
+                } else if (arg == "--stdout") {
+                    options._stdout = true;
+                } else if (arg == "--incremental") {
+                    options._incremental = true;
+                } else if (arg == "--manifest") {
+                    readManifest(nextValue(), options._inputFiles);
+                } else if (arg.size() > 1 && arg[0] == '@') {
+                    readManifest(arg.substr(1), options._inputFiles);
+                } else if (arg.size() > 1 && arg[0] == '-') {
+                    throw std::invalid_argument("Unknown option: " + arg);
+                } else {
+                    options._inputFiles.push_back(arg);
+                }
+            } catch (const std::out_of_range &) {
+                throw std::invalid_argument("Invalid value for " + arg);
+            }
+        }
+
+        if (options._stdout) {
+            options._format = "tar";
+            if (options._list || options._statsPath == "-") {
+                throw std::invalid_argument("--stdout cannot be combined with --list or --stats -.");
+            }
+        }
+        // The listing and the diff report own stdout, a JSON report after them would make it unparseable
+        if (options._statsPath == "-" && (options._list || options._command == "diff")) {
+            throw std::invalid_argument("--stats - cannot be combined with --list or diff, give the report a file.");
+        }
+        if (options._incremental && options._format != "dir") {
+            throw std::invalid_argument("--incremental only applies to the dir format.");
+        }
+        // Rewriting one name of a hardlinked file in place would change all of them
+        if (options._incremental && options._dedup == "link") {
+            throw std::invalid_argument("--incremental cannot be combined with --dedup link, use --dedup clone.");
+        }
+
+        if (!options._command.empty()) {
+            if (options._inputFiles.size() != 2) {
+                throw std::invalid_argument(options._command == "diff" ? "diff expects an old and a new archive." : "pack expects a directory and an archive.");
+            }
+            options._commandArgs = std::move(options._inputFiles);
+            options._inputFiles.clear();
+        }
+        return options;
+    }
+} // namespace cli
+
+#endif // OPTIONS_HPP
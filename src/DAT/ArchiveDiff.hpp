@@ -0,0 +1,218 @@
+#ifndef ARCHIVE_DIFF_HPP
+#define ARCHIVE_DIFF_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "spdlog/spdlog.h"
+#include "Utils/PathFilter.hpp"
+#include "Utils/ThreadPool.hpp"
+#include "IO/ArchiveSource.hpp"
+#include "BaseHandler.hpp"
+#include "Dat.hpp"
+
+namespace ntt
+{
+    // Differences between two versions of an archive, found without decoding a single entry.
+    // Files are matched by path and compared by sizes: different sizes are modified, equal ones have their stored bytes
+    // compared on the pool. The table holds no checksum of the contents, the CRC of an entry is the hash of its path,
+    // so only an entry compared to itself (same archive file, same offset) is known unchanged without reading it.
+    class ArchiveDiff
+    {
+        public:
+            struct Record {
+                std::uint32_t _pathHash; // The CRC of the table, equal for equal paths whatever the contents
+                std::uint32_t _dataAddr;
+                std::uint32_t _fileZsize;
+                std::uint32_t _fileSize;
+            };
+            struct Entry {
+                std::string _path;
+                Record _record;
+            };
+            struct Modification {
+                std::string _path;
+                Record _old;
+                Record _new;
+                bool _sameTable; // Only the stored bytes differ
+            };
+
+            static ArchiveDiff compare(const Dat &oldDat, const Dat &newDat, utils::ThreadPool &pool, const utils::PathFilter &filter = {});
+
+            const std::vector<Entry> &getAdded() const noexcept { return _added; }
+            const std::vector<Entry> &getRemoved() const noexcept { return _removed; }
+            const std::vector<Modification> &getModified() const noexcept { return _modified; }
+            bool empty() const noexcept { return _added.empty() && _removed.empty() && _modified.empty(); }
+            std::string toJson() const;
+
+        private:
+            std::string _oldPath;
+            std::string _newPath;
+            std::vector<Entry> _added; // In the order of the new table
+            std::vector<Entry> _removed; // In the order of the old table
+            std::vector<Modification> _modified; // In the order of the new table
+            std::size_t _unchanged{0};
+            std::size_t _comparedEntries{0};
+            std::size_t _comparedBytes{0};
+
+            static std::size_t _dataSize(const Record &record) noexcept { return record._fileSize != record._fileZsize ? record._fileZsize : record._fileSize; }
+            static bool _sameData(const ArchiveSource &oldSource, const Record &oldRecord, const ArchiveSource &newSource, const Record &newRecord);
+            static std::string _jsonString(std::string_view text);
+            static std::string _jsonRecord(const Record &record);
+    };
+
+    ArchiveDiff ArchiveDiff::compare(const Dat &oldDat, const Dat &newDat, utils::ThreadPool &pool, const utils::PathFilter &filter)
+    {
+        ArchiveDiff diff;
+        diff._oldPath = oldDat.getFilePath();
+        diff._newPath = newDat.getFilePath();
+
+        std::vector<Entry> oldEntries;
+        std::unordered_map<std::string_view, std::size_t> oldByPath;
+        oldEntries.reserve(oldDat.getEntryCount());
+        oldDat.forEachEntry([&](const FilesChunk::EntryView &entry) {
+            if (!entry._isDir && filter.matches(entry._pathName)) {
+                oldEntries.push_back({std::string(entry._pathName), {entry._crcValue, entry._dataAddr, entry._fileZsize, entry._fileSize}});
+            }
+        });
+        oldByPath.reserve(oldEntries.size());
+        for (std::size_t oldIndex = 0ull; oldIndex < oldEntries.size(); ++oldIndex) {
+            oldByPath.emplace(oldEntries[oldIndex]._path, oldIndex);
+        }
+
+        std::error_code errCode;
+        const bool sameFile = std::filesystem::equivalent(diff._oldPath, diff._newPath, errCode);
+        std::vector<bool> matched(oldEntries.size(), false);
+        std::vector<Modification> candidates; // In the order of the new table, those with the same sizes still to be compared
+        newDat.forEachEntry([&](const FilesChunk::EntryView &entry) {
+            if (entry._isDir || !filter.matches(entry._pathName)) {
+                return;
+            }
+            const Record record{entry._crcValue, entry._dataAddr, entry._fileZsize, entry._fileSize};
+            auto it = oldByPath.find(entry._pathName);
+            if (it == oldByPath.end()) {
+                diff._added.push_back({std::string(entry._pathName), record});
+                return;
+            }
+
+            matched[it->second] = true;
+            const Record &oldRecord = oldEntries[it->second]._record;
+            if (oldRecord._fileZsize != record._fileZsize || oldRecord._fileSize != record._fileSize) {
+                candidates.push_back({std::string(entry._pathName), oldRecord, record, false});
+            } else if (sameFile && oldRecord._dataAddr == record._dataAddr) {
+                diff._unchanged += 1;
+            } else {
+                candidates.push_back({std::string(entry._pathName), oldRecord, record, true});
+            }
+        });
+        for (std::size_t oldIndex = 0ull; oldIndex < oldEntries.size(); ++oldIndex) {
+            if (!matched[oldIndex]) {
+                diff._removed.push_back(std::move(oldEntries[oldIndex]));
+            }
+        }
+
+        std::vector<char> sameData(candidates.size(), 0);
+        for (std::size_t candidateIndex = 0ull; candidateIndex < candidates.size(); ++candidateIndex) {
+            if (!candidates[candidateIndex]._sameTable) {
+                continue;
+            }
+            pool.submit([&oldDat, &newDat, &candidates, &sameData, candidateIndex](std::size_t) {
+                sameData[candidateIndex] = _sameData(oldDat.getSource(), candidates[candidateIndex]._old, newDat.getSource(), candidates[candidateIndex]._new) ? 1 : 0;
+            });
+        }
+        pool.wait();
+
+        for (std::size_t candidateIndex = 0ull; candidateIndex < candidates.size(); ++candidateIndex) {
+            if (!candidates[candidateIndex]._sameTable) {
+                diff._modified.push_back(std::move(candidates[candidateIndex]));
+                continue;
+            }
+            diff._comparedEntries += 1;
+            diff._comparedBytes += _dataSize(candidates[candidateIndex]._new);
+            if (sameData[candidateIndex]) {
+                diff._unchanged += 1;
+            } else {
+                diff._modified.push_back(std::move(candidates[candidateIndex]));
+            }
+        }
+        return diff;
+    }
+
+    // Ranges are compared window by window, so that an unmapped archive only needs two windows of memory.
+    // A range outside of its archive never compares equal.
+    bool ArchiveDiff::_sameData(const ArchiveSource &oldSource, const Record &oldRecord, const ArchiveSource &newSource, const Record &newRecord)
+    {
+        const std::size_t size = _dataSize(newRecord);
+        std::vector<std::byte> oldScratch;
+        std::vector<std::byte> newScratch;
+        try {
+            for (std::size_t offset = 0ull; offset < size; offset += BaseHandler::STREAM_WINDOW) {
+                const std::size_t window = std::min(BaseHandler::STREAM_WINDOW, size - offset);
+                std::span<const std::byte> oldData = oldSource.read(oldRecord._dataAddr + offset, window, oldScratch);
+                std::span<const std::byte> newData = newSource.read(newRecord._dataAddr + offset, window, newScratch);
+                if (std::memcmp(oldData.data(), newData.data(), window) != 0) {
+                    return false;
+                }
+            }
+        } catch (const std::out_of_range &) {
+            return false;
+        }
+        return true;
+    }
+
+    std::string ArchiveDiff::_jsonString(std::string_view text)
+    {
+        std::string json = "\"";
+        for (const char c : text) {
+            if (c == '"' || c == '\\') {
+                json.push_back('\\');
+                json.push_back(c);
+            } else if (static_cast<unsigned char>(c) < 0x20) {
+                json += spdlog::fmt_lib::format("\\u{:04x}", static_cast<unsigned char>(c));
+            } else {
+                json.push_back(c);
+            }
+        }
+        json.push_back('"');
+        return json;
+    }
+
+    std::string ArchiveDiff::_jsonRecord(const Record &record)
+    {
+        return spdlog::fmt_lib::format("{{\"path_hash\": \"{:08x}\", \"offset\": {}, \"zsize\": {}, \"size\": {}}}", record._pathHash, record._dataAddr, record._fileZsize, record._fileSize);
+    }
+
+    std::string ArchiveDiff::toJson() const
+    {
+        auto appendEntries = [](std::string &json, const char *name, const std::vector<Entry> &entries) {
+            json += spdlog::fmt_lib::format("  \"{}\": [", name);
+            for (std::size_t index = 0ull; index < entries.size(); ++index) {
+                json += spdlog::fmt_lib::format("{}\n    {{\"path\": {}, \"entry\": {}}}", index == 0 ? "" : ",", _jsonString(entries[index]._path), _jsonRecord(entries[index]._record));
+            }
+            json += entries.empty() ? "],\n" : "\n  ],\n";
+        };
+
+        std::string json = "{\n";
+        json += spdlog::fmt_lib::format("  \"old\": {},\n  \"new\": {},\n", _jsonString(_oldPath), _jsonString(_newPath));
+        json += spdlog::fmt_lib::format("  \"unchanged\": {},\n  \"compared_entries\": {},\n  \"compared_bytes\": {},\n", _unchanged, _comparedEntries, _comparedBytes);
+        appendEntries(json, "added", _added);
+        appendEntries(json, "removed", _removed);
+        json += "  \"modified\": [";
+        for (std::size_t index = 0ull; index < _modified.size(); ++index) {
+            const Modification &modification = _modified[index];
+            json += spdlog::fmt_lib::format("{}\n    {{\"path\": {}, \"change\": \"{}\", \"old\": {}, \"new\": {}}}", index == 0 ? "" : ",", _jsonString(modification._path),
+                modification._sameTable ? "data" : "table", _jsonRecord(modification._old), _jsonRecord(modification._new));
+        }
+        json += _modified.empty() ? "]\n}\n" : "\n  ]\n}\n";
+        return json;
+    }
+} // namespace ntt
+
+#endif // ARCHIVE_DIFF_HPP
@@ -14,6 +14,9 @@
 #include <memory>
 #include "spdlog/spdlog.h"
 #include "Utils/Utils.hpp"
+#include "IO/ArchiveSource.hpp"
+#include "IO/FooterLocator.hpp"
+#include "IO/IndexFile.hpp"
 #include "FilesChunk.hpp"
 
 namespace ntt
@@ -21,19 +24,21 @@ namespace ntt
     class Dat
     {
         public:
-            explicit Dat(const std::string &inputFile);
+            // progressLevel is the level of the lines reporting progress (opening, index, table size, closing),
+            // warnings and errors keep theirs. Programs embedding the archive reader lower it to debug.
+            explicit Dat(const std::string &inputFile, spdlog::level::level_enum progressLevel = spdlog::level::info);
             ~Dat();
 
             const std::string &getFilePath() const noexcept { return _datFilePath; }
             const std::size_t getFileSize() const noexcept { return _fileSize; }
-            const std::vector<std::byte> &getFileBuffer() const noexcept { return _fileBuffer; }
+            const ArchiveSource &getSource() const noexcept { return _source; }
 
             std::string readBytesInHex(std::size_t offset, std::size_t n) const;
 
             void readMagicHeader();
             void extractLZ2K();
 
-            std::ptrdiff_t getFilesChunkOffset(const std::string &chunkSign) const;
+            std::ptrdiff_t getFilesChunkOffset(const std::string &chunkSign, std::size_t tailWindow = FooterLocator::DEFAULT_TAIL_WINDOW) const;
 
             void setFilesChunkHeader(const ptrdiff_t headerOffset) { _filesChunk->setChunkHeader(headerOffset); };
             void parseFilesChunk() { _filesChunk->parseChunk(); };
@@ -41,72 +46,68 @@ namespace ntt
             void setCRCdatabase() { _filesChunk->defineCRCdatabase(); };
             void computeCRC() { _filesChunk->computeCRC(); };
             void readFilesBuffer() { _filesChunk->readFilesOffsetBuffer(); };
-            void decompressFiles() { _filesChunk->decompressFiles(); };
+            void decompressFiles(utils::ThreadPool &pool, const utils::PathFilter &filter = {}) { _filesChunk->decompressFiles(pool, filter); };
+            std::size_t verifyFiles(utils::ThreadPool &pool, const utils::PathFilter &filter = {}, utils::Stats *stats = nullptr) { return _filesChunk->verifyFiles(pool, filter, stats); };
+            void scheduleFiles(utils::ThreadPool &pool, Output &output, utils::MemoryBudget &budget, std::function<void()> onComplete, const utils::PathFilter &filter = {}, utils::Stats *stats = nullptr, ExtractionManifest *manifest = nullptr, DedupIndex *dedup = nullptr) { _filesChunk->scheduleFiles(pool, output, budget, std::move(onComplete), filter, stats, manifest, dedup); };
+            std::vector<std::byte> extract(std::string_view path) const { return _filesChunk->extract(path); }
+            std::vector<FilesChunk::EntryListing> listFiles(const utils::PathFilter &filter = {}) const { return _filesChunk->listFiles(filter); }
+            std::size_t getMemoryFootprint() const noexcept { return _filesChunk->getMemoryFootprint(); }
+            std::size_t getEntryCount() const noexcept { return _filesChunk->getEntryCount(); }
+            template <typename Visitor>
+            void forEachEntry(Visitor &&visit) const { _filesChunk->forEachEntry(std::forward<Visitor>(visit)); }
+
+            // Restores the table of contents from an index instead of parsing it; false when the index is missing or out of date.
+            bool loadIndex(const std::string &indexPath);
+            // Failures are only logged, the index is an optimisation
+            void saveIndex(const std::string &indexPath) const;
 
         private:
             std::string _datFilePath;
-            std::ifstream _datFile;
+            spdlog::level::level_enum _progressLevel;
+            ArchiveSource _source;
             std::size_t _fileSize{0};
-            std::vector<std::byte> _fileBuffer;
             std::unordered_map<std::string, std::function<void()>> _magicSign;
             std::unique_ptr<FilesChunk> _filesChunk;
+            std::vector<std::size_t> _headerOffsetHints; // From an outdated index, tried first by the footer search
 
-            void _readFile();
             void _initializeMagicSignMap();
     };
 
-    Dat::Dat(const std::string &inputFile)
-        : _datFilePath(inputFile), _datFile(inputFile, std::ios::binary | std::ios::ate)
+    Dat::Dat(const std::string &inputFile, spdlog::level::level_enum progressLevel)
+        : _datFilePath(inputFile), _progressLevel(progressLevel), _source(inputFile)
     {
-        if (!_datFile)
-        {
-            throw std::ios_base::failure("Failed to open file: " + _datFilePath);
-        }
+        spdlog::log(_progressLevel, "Reading file {}", _datFilePath);
 
-        spdlog::info("Reading file {}", _datFilePath);
-
-        _fileSize = _datFile.tellg();
+        _fileSize = _source.getSize();
         if (_fileSize == 0)
         {
             spdlog::warn("File is empty: {}", _datFilePath);
         }
         else
         {
-            _fileBuffer.resize(_fileSize);
-            _datFile.seekg(std::ios::beg);
-            _readFile();
+            spdlog::log(_progressLevel, "{} {} bytes from {}", _source.isMapped() ? "Mapped" : "Opened", _fileSize, _datFilePath);
         }
 
         _initializeMagicSignMap();
-        _filesChunk = std::make_unique<FilesChunk>(_fileBuffer, _fileSize);
-    }
-
-    void Dat::_readFile()
-    {
-        _datFile.seekg(0, std::ios::beg);
-        _datFile.read(reinterpret_cast<char *>(_fileBuffer.data()), _fileSize);
-
-        if (!_datFile)
-        {
-            throw std::ios_base::failure("Error while reading file: " + _datFilePath);
-        }
-        spdlog::info("Successfully read {} bytes from {}", _fileSize, _datFilePath);
+        _filesChunk = std::make_unique<FilesChunk>(_source, _progressLevel);
     }
 
     std::string Dat::readBytesInHex(std::size_t offset, std::size_t n) const
     {
-        if (offset >= _fileBuffer.size())
+        if (offset >= _fileSize)
         {
             throw std::out_of_range("Offset is beyond the end of the file buffer.");
         }
 
-        n = std::min(n, _fileBuffer.size() - offset);
+        n = std::min(n, _fileSize - offset);
+        std::vector<std::byte> scratch;
+        std::span<const std::byte> bytes = _source.read(offset, n, scratch);
         std::ostringstream hexStream;
         hexStream << std::hex << std::uppercase << std::setfill('0');
 
         for (std::size_t i = 0; i < n; ++i)
         {
-            hexStream << std::setw(2) << static_cast<unsigned int>(std::to_integer<unsigned char>(_fileBuffer[offset + i]));
+            hexStream << std::setw(2) << static_cast<unsigned int>(std::to_integer<unsigned char>(bytes[i]));
             if (i != n - 1)
             {
                 hexStream << " ";
@@ -118,7 +119,7 @@ namespace ntt
 
     void Dat::readMagicHeader()
     {
-        spdlog::info("Magic header: {}", readBytesInHex(0x0, 0x7));
+        spdlog::log(_progressLevel, "Magic header: {}", readBytesInHex(0x0, 0x7));
     }
 
     void Dat::_initializeMagicSignMap()
@@ -132,41 +133,45 @@ namespace ntt
         return;
     }
 
-    // Get the .CC40TAD offset
-    std::ptrdiff_t Dat::getFilesChunkOffset(const std::string &chunkSign) const
+    // Get the .CC40TAD offset, searching at most the last tailWindow bytes (0 for the whole archive)
+    std::ptrdiff_t Dat::getFilesChunkOffset(const std::string &chunkSign, std::size_t tailWindow) const
     {
-        if (chunkSign.empty() || _fileBuffer.size() < chunkSign.size())
-        {
-            return -1;
-        }
+        FooterLocator locator(_source, chunkSign, tailWindow);
+        return locator.locate(_headerOffsetHints);
+    }
 
-        for (std::vector<std::byte>::difference_type i = _fileBuffer.size() - chunkSign.size(); i >= 0; --i)
-        {
-            bool found = true;
-            for (std::size_t j = 0; j < chunkSign.size(); ++j)
-            {
-                if (_fileBuffer[i + j] != static_cast<std::byte>(chunkSign[j]))
-                {
-                    found = false;
-                    break;
-                }
-            }
-            if (found)
-            {
-                return i;
-            }
+    bool Dat::loadIndex(const std::string &indexPath)
+    {
+        IndexFile index(indexPath);
+        if (!index.isOpen()) {
+            return false;
+        }
+        if (!index.matches(_source)) {
+            spdlog::log(_progressLevel, "Index {} is out of date", indexPath);
+            _headerOffsetHints.push_back(index.getHeader()._headerOffset);
+            return false;
         }
+        if (!_filesChunk->loadIndex(index)) {
+            spdlog::warn("Ignoring the index {}: inconsistent entries", indexPath);
+            return false;
+        }
+        spdlog::log(_progressLevel, "Loaded {} entries from index {}", _filesChunk->getEntryCount(), indexPath);
+        return true;
+    }
 
-        return -1;
+    void Dat::saveIndex(const std::string &indexPath) const
+    {
+        try {
+            _filesChunk->saveIndex(indexPath);
+            spdlog::log(_progressLevel, "Saved index {}", indexPath);
+        } catch (const std::ios_base::failure &e) {
+            spdlog::warn("Could not save the index: {}", e.what());
+        }
     }
 
     Dat::~Dat()
     {
-        if (_datFile.is_open())
-        {
-            _datFile.close();
-            spdlog::info("Closed file {}", _datFilePath);
-        }
+        spdlog::log(_progressLevel, "Closed file {}", _datFilePath);
     }
 
 } // namespace ntt
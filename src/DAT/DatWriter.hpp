@@ -0,0 +1,396 @@
+#ifndef DAT_WRITER_HPP
+#define DAT_WRITER_HPP
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <zlib.h>
+#include "spdlog/spdlog.h"
+#include "Utils/PathHash.hpp"
+#include "Utils/Stats.hpp"
+#include "Utils/ThreadPool.hpp"
+
+namespace ntt
+{
+    // Builds an archive from a directory tree, laid out the way FilesChunk reads it:
+    // a 16 bytes header, the entry data, then the big-endian table of contents introduced by ".CC40TAD".
+    // Files are cut into blocks that the pool packs as ZIPX chunks while this thread appends the finished ones
+    // in order, so at most a window of blocks is held in memory whatever the size of the tree.
+    class DatWriter
+    {
+        public:
+            static constexpr std::size_t CHUNK_SIZE = 0x20000; // Input of one ZIPX chunk
+            static constexpr std::size_t BLOCK_SIZE = 8 * CHUNK_SIZE; // Input of one packing task
+            static constexpr std::uint32_t CHUNK_VERSION = 1;
+            static constexpr std::string_view MAGIC{"HDR\0HDR\0HDR\0HDR\0", 16}; // Not interpreted by the reader
+
+            // Data record of a file, crc being the hash of its path
+            struct FileRecord {
+                std::uint32_t _crc;
+                std::uint32_t _dataAddr;
+                std::uint32_t _zsize;
+                std::uint32_t _size;
+            };
+            struct Summary {
+                std::size_t _files{0};
+                std::size_t _directories{0};
+                std::size_t _bytesIn{0};
+                std::size_t _bytesOut{0};
+            };
+
+            // Lists the tree under root. Throws std::out_of_range when it cannot be represented in an archive:
+            // directory names must not contain '.', file names must, and there are at most 65535 directories.
+            explicit DatWriter(const std::string &root, int level = Z_DEFAULT_COMPRESSION);
+
+            std::size_t getFileCount() const noexcept { return _files.size(); }
+            std::size_t getDirectoryCount() const noexcept { return _directories.size(); }
+
+            // Replaces archivePath atomically, throws std::ios_base::failure when a file cannot be read or written
+            Summary write(const std::string &archivePath, utils::ThreadPool &pool, utils::Stats *stats = nullptr) const;
+
+            // Packs data as ZIPX chunks of CHUNK_SIZE bytes, each stored as is when deflating does not shrink it
+            static std::vector<std::byte> packZipx(std::span<const std::byte> data, int level = Z_DEFAULT_COMPRESSION);
+            // Table of contents of the entries named in table order, with the parent id of each (0 at the top level),
+            // and the data records of the files. Appended after the entry data, it ends the archive.
+            static std::vector<std::byte> buildTable(const std::vector<std::string> &names, const std::vector<std::uint16_t> &parentIds, std::vector<FileRecord> records);
+
+        private:
+            struct Node {
+                std::string _path; // Relative to the root, with '/' separators
+                std::size_t _size; // Bytes of a file, 0 for a directory
+            };
+            struct Block {
+                std::size_t _file;
+                std::size_t _offset;
+                std::size_t _size;
+            };
+
+            const std::string _root;
+            const int _level;
+            std::vector<Node> _directories; // Sorted, so that parents come before their children
+            std::vector<Node> _files; // Sorted
+
+            static std::string _nameOf(const std::string &path) { return path.substr(path.rfind('/') + 1); }
+            static void _put16(std::vector<std::byte> &buffer, std::uint16_t value);
+            static void _put32(std::vector<std::byte> &buffer, std::uint32_t value);
+            std::vector<std::byte> _packBlock(const Block &block) const;
+            std::vector<std::byte> _buildTable(std::vector<FileRecord> records) const;
+    };
+
+    DatWriter::DatWriter(const std::string &root, int level)
+        : _root(root), _level(level)
+    {
+        std::error_code error;
+        if (!std::filesystem::is_directory(_root, error)) {
+            throw std::ios_base::failure("Not a directory: " + _root);
+        }
+
+        for (auto it = std::filesystem::recursive_directory_iterator(_root, error); !error && it != std::filesystem::recursive_directory_iterator(); it.increment(error)) {
+            const std::string path = std::filesystem::relative(it->path(), _root).generic_string();
+            const std::string name = _nameOf(path);
+            if (it->is_directory()) {
+                if (name.find('.') != std::string::npos) {
+                    throw std::out_of_range("Directory names cannot contain '.' in an archive: " + path);
+                }
+                _directories.push_back({path, 0ull});
+            } else if (it->is_regular_file()) {
+                if (name.find('.') == std::string::npos) {
+                    throw std::out_of_range("File names need a '.' in an archive: " + path);
+                }
+                if (it->file_size() > 0xFFFFFFFFull) {
+                    throw std::out_of_range("Files of 4 GB or more cannot be packed: " + path);
+                }
+                _files.push_back({path, static_cast<std::size_t>(it->file_size())});
+            } else {
+                spdlog::warn("Skipping {}, which is neither a file nor a directory", path);
+            }
+        }
+        if (error) {
+            throw std::ios_base::failure("Failed to list " + _root + ": " + error.message());
+        }
+        // Directories are referred to by 16 bits ids, so they come first
+        if (_directories.size() > 0xFFFF) {
+            throw std::out_of_range("An archive holds at most 65535 directories, " + _root + " has " + std::to_string(_directories.size()));
+        }
+
+        auto byPath = [](const Node &lhs, const Node &rhs) { return lhs._path < rhs._path; };
+        std::sort(_directories.begin(), _directories.end(), byPath);
+        std::sort(_files.begin(), _files.end(), byPath);
+    }
+
+    void DatWriter::_put16(std::vector<std::byte> &buffer, std::uint16_t value)
+    {
+        buffer.push_back(static_cast<std::byte>(value >> 8));
+        buffer.push_back(static_cast<std::byte>(value & 0xFF));
+    }
+
+    void DatWriter::_put32(std::vector<std::byte> &buffer, std::uint32_t value)
+    {
+        _put16(buffer, static_cast<std::uint16_t>(value >> 16));
+        _put16(buffer, static_cast<std::uint16_t>(value & 0xFFFF));
+    }
+
+    std::vector<std::byte> DatWriter::packZipx(std::span<const std::byte> data, int level)
+    {
+        std::vector<std::byte> entry;
+        std::vector<std::byte> packed(compressBound(static_cast<uLong>(std::min(CHUNK_SIZE, data.size()))));
+        auto putLE32 = [&entry](std::uint32_t value) {
+            for (unsigned shift = 0; shift < 32; shift += 8) {
+                entry.push_back(static_cast<std::byte>(value >> shift));
+            }
+        };
+
+        for (std::size_t offset = 0ull; offset < data.size(); offset += CHUNK_SIZE) {
+            const std::span<const std::byte> chunk = data.subspan(offset, std::min(CHUNK_SIZE, data.size() - offset));
+            uLongf packedSize = static_cast<uLongf>(packed.size());
+            if (compress2(reinterpret_cast<Bytef *>(packed.data()), &packedSize,
+                    reinterpret_cast<const Bytef *>(chunk.data()), static_cast<uLong>(chunk.size()), level) != Z_OK) {
+                throw std::runtime_error("zlib failed to compress a chunk");
+            }
+            const bool stored = packedSize >= chunk.size();
+            for (const char c : {'Z', 'I', 'P', 'X'}) {
+                entry.push_back(static_cast<std::byte>(c));
+            }
+            putLE32(static_cast<std::uint32_t>(chunk.size()));
+            putLE32(static_cast<std::uint32_t>(stored ? chunk.size() : packedSize));
+            if (stored) {
+                entry.insert(entry.end(), chunk.begin(), chunk.end());
+            } else {
+                entry.insert(entry.end(), packed.begin(), packed.begin() + packedSize);
+            }
+        }
+        return entry;
+    }
+
+    // A file of a single block is stored as is when packing does not shrink it. Larger files are always packed,
+    // their chunks being stored one by one instead.
+    std::vector<std::byte> DatWriter::_packBlock(const Block &block) const
+    {
+        const Node &file = _files[block._file];
+        std::vector<std::byte> input(block._size);
+        if (block._size != 0) {
+            std::ifstream stream(_root + "/" + file._path, std::ios::in | std::ios::binary);
+            stream.seekg(static_cast<std::streamoff>(block._offset));
+            stream.read(reinterpret_cast<char *>(input.data()), static_cast<std::streamsize>(input.size()));
+            if (!stream) {
+                throw std::ios_base::failure("Failed to read " + _root + "/" + file._path);
+            }
+        }
+
+        std::vector<std::byte> packed = packZipx(input, _level);
+        if (file._size <= BLOCK_SIZE && packed.size() >= input.size()) {
+            return input;
+        }
+        return packed;
+    }
+
+    DatWriter::Summary DatWriter::write(const std::string &archivePath, utils::ThreadPool &pool, utils::Stats *stats) const
+    {
+        utils::Stats::Timer timer(stats, "pack");
+        std::vector<Block> blocks;
+        for (std::size_t fileIndex = 0ull; fileIndex < _files.size(); ++fileIndex) {
+            std::size_t offset = 0ull;
+            do {
+                const std::size_t size = std::min(BLOCK_SIZE, _files[fileIndex]._size - offset);
+                blocks.push_back({fileIndex, offset, size});
+                offset += size;
+            } while (offset < _files[fileIndex]._size);
+        }
+
+        // Finished blocks wait in a ring of slots until every block before them was written
+        struct Slot {
+            std::vector<std::byte> _data;
+            bool _ready{false};
+        };
+        const std::size_t window = 2 * pool.getThreadCount() + 2;
+        std::vector<Slot> slots(window);
+        std::mutex slotMutex;
+        std::condition_variable slotCondition;
+        auto submit = [&](std::size_t blockIndex) {
+            pool.submit([&, blockIndex](std::size_t) {
+                std::vector<std::byte> data;
+                try {
+                    data = _packBlock(blocks[blockIndex]);
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock(slotMutex);
+                    slots[blockIndex % window]._ready = true;
+                    slotCondition.notify_all();
+                    throw;
+                }
+                std::lock_guard<std::mutex> lock(slotMutex);
+                slots[blockIndex % window] = {std::move(data), true};
+                slotCondition.notify_all();
+            });
+        };
+
+        const std::string temporaryPath = archivePath + ".tmp";
+        std::ofstream archive(temporaryPath, std::ios::out | std::ios::binary | std::ios::trunc);
+        archive.write(MAGIC.data(), static_cast<std::streamsize>(MAGIC.size()));
+
+        Summary summary{_files.size(), _directories.size(), 0ull, MAGIC.size()};
+        std::vector<FileRecord> records(_files.size());
+        std::size_t nextBlock = 0ull;
+        try {
+            for (std::size_t blockIndex = 0ull; blockIndex < blocks.size(); ++blockIndex) {
+                for (; nextBlock < blocks.size() && nextBlock < blockIndex + window; ++nextBlock) {
+                    submit(nextBlock);
+                }
+
+                std::vector<std::byte> data;
+                {
+                    std::unique_lock<std::mutex> lock(slotMutex);
+                    slotCondition.wait(lock, [&]() { return slots[blockIndex % window]._ready; });
+                    data = std::move(slots[blockIndex % window]._data);
+                    slots[blockIndex % window] = {};
+                }
+
+                const Block &block = blocks[blockIndex];
+                FileRecord &record = records[block._file];
+                if (block._offset == 0) {
+                    record = {utils::pathHash(_files[block._file]._path), static_cast<std::uint32_t>(summary._bytesOut), 0u, static_cast<std::uint32_t>(_files[block._file]._size)};
+                }
+                if (data.empty() && block._size != 0) {
+                    break; // The task failed, pool.wait() below rethrows its error
+                }
+                // A packed file the size of its data would read as stored, the reader ignores what follows the last chunk
+                const bool lastBlock = block._offset + block._size == _files[block._file]._size;
+                if (lastBlock && _files[block._file]._size > BLOCK_SIZE && record._zsize + data.size() == record._size) {
+                    data.push_back(std::byte{0});
+                }
+                if (summary._bytesOut + data.size() > 0xFFFFFFFFull) {
+                    throw std::out_of_range("Archives are limited to 4 GB of data");
+                }
+                archive.write(reinterpret_cast<const char *>(data.data()), static_cast<std::streamsize>(data.size()));
+                record._zsize += static_cast<std::uint32_t>(data.size());
+                summary._bytesIn += block._size;
+                summary._bytesOut += data.size();
+            }
+            pool.wait();
+        } catch (...) {
+            pool.wait();
+            std::error_code error;
+            archive.close();
+            std::filesystem::remove(temporaryPath, error);
+            throw;
+        }
+
+        const std::vector<std::byte> table = _buildTable(std::move(records));
+        archive.write(reinterpret_cast<const char *>(table.data()), static_cast<std::streamsize>(table.size()));
+        summary._bytesOut += table.size();
+        archive.close();
+        std::error_code error;
+        if (!archive) {
+            std::filesystem::remove(temporaryPath, error);
+            throw std::ios_base::failure("Failed to write archive: " + temporaryPath);
+        }
+        std::filesystem::rename(temporaryPath, archivePath, error);
+        if (error) {
+            std::filesystem::remove(temporaryPath, error);
+            throw std::ios_base::failure("Failed to replace archive: " + archivePath);
+        }
+
+        timer.setBytes(summary._bytesIn, summary._bytesOut);
+        timer.setEntries(_files.size());
+        return summary;
+    }
+
+    // Directories then files, each directory taking the id of its position so that its children can refer to it
+    std::vector<std::byte> DatWriter::_buildTable(std::vector<FileRecord> records) const
+    {
+        std::vector<std::string> names;
+        std::vector<std::uint16_t> parentIds;
+        std::unordered_map<std::string, std::uint16_t> directoryIds;
+        names.reserve(_directories.size() + _files.size());
+        parentIds.reserve(_directories.size() + _files.size());
+        auto addName = [&](const std::string &path) {
+            const std::size_t parentEnd = path.rfind('/');
+            parentIds.push_back(parentEnd == std::string::npos ? 0 : directoryIds.at(path.substr(0, parentEnd)));
+            names.push_back(_nameOf(path));
+        };
+        for (const Node &directory : _directories) {
+            addName(directory._path);
+            directoryIds.emplace(directory._path, static_cast<std::uint16_t>(names.size()));
+        }
+        for (const Node &file : _files) {
+            addName(file._path);
+        }
+        return buildTable(names, parentIds, std::move(records));
+    }
+
+    // Names with the 12 bytes record of each, then the data records and the CRC table, both sorted by CRC.
+    // Entry ids start at 1, 0 being the parent of top level entries.
+    std::vector<std::byte> DatWriter::buildTable(const std::vector<std::string> &names, const std::vector<std::uint16_t> &parentIds, std::vector<FileRecord> records)
+    {
+        if (names.size() != parentIds.size()) {
+            throw std::invalid_argument("Every name needs a parent id");
+        }
+        std::vector<std::byte> table;
+        _put32(table, 0); // Size of the table, patched at the end
+        for (const char c : std::string(".CC40TAD")) {
+            table.push_back(static_cast<std::byte>(c));
+        }
+        _put32(table, 0);
+        _put32(table, CHUNK_VERSION);
+        _put32(table, static_cast<std::uint32_t>(records.size()));
+        _put32(table, 0);
+        const std::size_t nameTableSizeOffset = table.size();
+        _put32(table, 0);
+
+        std::vector<std::uint32_t> nameOffsets;
+        nameOffsets.reserve(names.size());
+        const std::size_t nameTableOffset = table.size();
+        for (const std::string &name : names) {
+            nameOffsets.push_back(static_cast<std::uint32_t>(table.size() - nameTableOffset));
+            for (const char c : name) {
+                table.push_back(static_cast<std::byte>(c));
+            }
+            table.push_back(std::byte{0});
+            table.push_back(std::byte{1}); // The reader skips one byte after each name
+        }
+        _put16(table, 0);
+        const std::uint32_t nameTableSize = static_cast<std::uint32_t>(table.size() - nameTableOffset);
+        for (std::size_t i = 0ull; i < 4ull; ++i) {
+            table[nameTableSizeOffset + i] = static_cast<std::byte>(nameTableSize >> (24 - 8 * i));
+        }
+
+        table.insert(table.end(), 0x10, std::byte{0});
+        for (std::size_t nameIndex = 0ull; nameIndex < nameOffsets.size(); ++nameIndex) {
+            _put32(table, nameOffsets[nameIndex]);
+            _put16(table, parentIds[nameIndex]);
+            _put16(table, 0);
+            _put16(table, 0);
+            _put16(table, static_cast<std::uint16_t>(nameIndex + 1)); // Wraps for files past 65535 entries, which nothing refers to
+        }
+
+        std::stable_sort(records.begin(), records.end(), [](const FileRecord &lhs, const FileRecord &rhs) { return lhs._crc < rhs._crc; });
+        _put32(table, 0);
+        _put32(table, static_cast<std::uint32_t>(records.size()));
+        for (const FileRecord &record : records) {
+            _put32(table, 0);
+            _put32(table, record._dataAddr);
+            _put32(table, record._zsize);
+            _put32(table, record._size);
+        }
+        for (const FileRecord &record : records) {
+            _put32(table, record._crc);
+        }
+
+        const std::uint32_t tableSize = static_cast<std::uint32_t>(table.size() - 4);
+        for (std::size_t i = 0ull; i < 4ull; ++i) {
+            table[i] = static_cast<std::byte>(tableSize >> (24 - 8 * i));
+        }
+        return table;
+    }
+} // namespace ntt
+
+#endif // DAT_WRITER_HPP
@@ -3,13 +3,35 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
 #include <vector>
 #include <stdexcept>
-#include <filesystem>
-#include <fstream>
 #include <array>
+#include <chrono>
+#include <span>
+#include <algorithm>
+#include <unordered_map>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <future>
+#include <string_view>
+#include <optional>
 #include "spdlog/spdlog.h"
 #include "Utils/Utils.hpp"
+#include "Utils/BinaryCursor.hpp"
+#include "Utils/PathHash.hpp"
+#include "Utils/PathFilter.hpp"
+#include "Utils/ThreadPool.hpp"
+#include "Utils/MemoryBudget.hpp"
+#include "Utils/Stats.hpp"
+#include "IO/ArchiveSource.hpp"
+#include "IO/Output.hpp"
+#include "IO/DirectoryOutput.hpp"
+#include "IO/IndexFile.hpp"
+#include "IO/ExtractionManifest.hpp"
+#include "IO/ReadPlan.hpp"
+#include "IO/DedupIndex.hpp"
 #include "BaseHandler.hpp"
 #include "ZipX.hpp"
 #include "LZ2K.hpp"
@@ -19,38 +41,114 @@ namespace ntt
     class FilesChunk
     {
         public:
-            FilesChunk(const std::vector<std::byte> &_fileBuffer, const std::size_t &_fileBufferSize);
+            // What an entry looks like in the table of contents, without touching its data
+            struct EntryListing {
+                std::string _pathName;
+                std::uint32_t _dataAddr;
+                std::uint32_t _fileZsize;
+                std::uint32_t _fileSize;
+                std::string _codec; // Signature of compressed entries, "stored" otherwise
+            };
+            // An entry of the table, directories included, valid while the chunk lives
+            struct EntryView {
+                std::string_view _pathName;
+                std::uint32_t _nameLength; // The file name is the end of _pathName
+                bool _isDir;
+                std::uint32_t _dataAddr;
+                std::uint32_t _fileZsize;
+                std::uint32_t _fileSize;
+                std::uint32_t _crcValue; // Hash of the path, as found in the CRC table
+            };
+
+            // progressLevel is the level of the lines reporting progress, warnings and errors keep theirs
+            explicit FilesChunk(const ArchiveSource &source, spdlog::level::level_enum progressLevel = spdlog::level::info);
             ~FilesChunk();
 
             void setChunkHeader(const ptrdiff_t headerOffset);
             void parseChunk();
             void getFilesOffset();
 
-            void addFile(bool isDir, const std::uint16_t parentId, const std::uint16_t id, const std::string &fileName, const std::uint32_t addr);
+            void addFile(bool isDir, const std::uint16_t parentId, const std::uint16_t id, std::string_view fileName, const std::uint32_t addr);
             void defineCRCdatabase();
             void computeCRC();
             void readFilesOffsetBuffer();
-            void decompressFiles();
+            void decompressFiles(utils::ThreadPool &pool, const utils::PathFilter &filter = {});
+            void scheduleFiles(utils::ThreadPool &pool, Output &output, utils::MemoryBudget &budget, std::function<void()> onComplete, const utils::PathFilter &filter = {}, utils::Stats *stats = nullptr, ExtractionManifest *manifest = nullptr, DedupIndex *dedup = nullptr);
+            std::vector<std::byte> extract(std::string_view path) const;
+            // Checks on the pool that every file matching filter has its CRC in the table and its data inside the archive,
+            // and that compressed files decode to their size. Nothing is written. Returns the count of failed files once done.
+            std::size_t verifyFiles(utils::ThreadPool &pool, const utils::PathFilter &filter = {}, utils::Stats *stats = nullptr);
+
+            // Replace setChunkHeader() to computeCRC(). loadIndex() returns false when the index is malformed.
+            bool loadIndex(const IndexFile &index);
+            void saveIndex(const std::string &indexPath) const;
+
+            std::vector<EntryListing> listFiles(const utils::PathFilter &filter = {}) const;
+            std::size_t getEntryCount() const noexcept { return _files.size(); }
+            // Calls visit with an EntryView of every entry, in table order
+            template <typename Visitor>
+            void forEachEntry(Visitor &&visit) const;
+            std::size_t getMemoryFootprint() const noexcept;
 
         private:
-            const std::vector<std::byte> &_fileBuffer;
-            const std::size_t &_fileBufferSize;
+            const ArchiveSource &_source;
+            const spdlog::level::level_enum _progressLevel;
+            const std::size_t _fileBufferSize;
+            std::vector<std::byte> _tocScratch; // Only used when the archive is not mapped
+            std::span<const std::byte> _toc; // From the chunk header to the end of the archive
+            std::size_t _tocOffset;
             struct CRCInfo {
                 std::uint32_t _dataAddr;
                 std::uint32_t _fileSize;
                 std::uint32_t _fileZsize;
                 std::uint32_t _packedVer;
-                std::string _crcPath;
                 std::uint32_t _crcValue;
             };
+            // Records of the table as stored, big-endian 32 bits words decoded by batches of RECORD_BATCH
+            struct NameRecord {
+                static constexpr std::size_t WORDS = 3; // 12 bytes, one per name of the name table
+                std::uint32_t _nameOffset;
+                std::uint16_t _parentId;
+                std::uint16_t _unknown0;
+                std::uint16_t _unknown1;
+                std::uint16_t _id;
+
+                static NameRecord decode(const std::uint32_t *words) noexcept {
+                    return {words[0], static_cast<std::uint16_t>(words[1] >> 16), static_cast<std::uint16_t>(words[1]), static_cast<std::uint16_t>(words[2] >> 16), static_cast<std::uint16_t>(words[2])};
+                }
+            };
+            struct DataRecord {
+                static constexpr std::size_t WORDS = 4; // 16 bytes, one per file sorted by CRC
+                std::uint32_t _packedVer;
+                std::uint32_t _dataAddr;
+                std::uint32_t _fileZsize;
+                std::uint32_t _fileSize;
+
+                static DataRecord decode(const std::uint32_t *words) noexcept {
+                    return {words[0], words[1], words[2], words[3]};
+                }
+            };
+            struct CrcRecord {
+                static constexpr std::size_t WORDS = 1; // One per file, in the order of the data records
+                std::uint32_t _crcValue;
+
+                static CrcRecord decode(const std::uint32_t *words) noexcept { return {words[0]}; }
+            };
+            static constexpr std::size_t RECORD_BATCH = 256;
             struct FileInfo {
                 bool _isDir;
                 std::uint16_t _parentDirId;
                 std::uint16_t _dirId;
                 std::string _pathName;
-                std::string _fileName;
+                std::uint32_t _nameLength; // The file name is the end of _pathName
                 CRCInfo _CRC;
-                std::vector<std::byte> _dataBuffer;
+                bool _hasData;
+                std::array<char, 4> _codec{}; // Signature of compressed entries when known from an index
+                bool _crcMatched{false}; // computeCRC() found a record of its own for the path
+
+                std::string_view fileName() const {
+                    return std::string_view(_pathName).substr(_pathName.size() - _nameLength);
+                }
 
                 bool operator==(const std::uint16_t parentDirId) const {
                     return _parentDirId == parentDirId;
@@ -64,16 +162,90 @@ namespace ntt
             std::uint32_t _FileCount;
             std::uint32_t _DirCount;
             std::vector<FileInfo> _files;
+            std::vector<std::uint32_t> _entryIndexById; // Index in _files of each 16 bits id, only alive while parsing
+            static constexpr std::uint32_t NO_ENTRY = 0xFFFFFFFF;
             std::size_t _filesChunkOffset;
             std::vector<std::uint32_t> _crcDatabase;
             std::vector<CRCInfo> _CRCs;
+            std::vector<std::pair<std::uint32_t, std::uint32_t>> _pathIndex; // (path hash, index in _files) of every file, sorted
+
+            // Per-entry log lines and decode figures, gathered by the workers and reported in entry order afterwards
+            struct EntryReport {
+                std::vector<std::pair<spdlog::level::level_enum, std::string>> _lines;
+                std::string _codec; // Codec signature or "stored", empty until the entry data was read
+                utils::Stats::Counters _decode;
+                bool _written{false}; // The file was written out
+                bool _failed{false}; // An error was reported
 
-            std::string _normalizeFilename(const std::string &fullname) const;
-            void _createFile(FileInfo &fileInfo) const;
+                template <typename... Args>
+                void add(spdlog::level::level_enum level, spdlog::format_string_t<Args...> format, Args &&...args) {
+                    _failed = _failed || level >= spdlog::level::err;
+                    // Lines the logger would drop are not even formatted
+                    if (spdlog::should_log(level)) {
+                        _lines.emplace_back(level, spdlog::fmt_lib::format(format, std::forward<Args>(args)...));
+                    }
+                }
+            };
+            // Codec contexts and buffers owned by one worker thread, shared by every archive it extracts
+            struct WorkerContext {
+                std::unordered_map<std::string, std::unique_ptr<ntt::BaseHandler>> _handlers;
+                std::vector<std::byte> _scratch;
+                std::vector<std::byte> _output;
+                std::vector<std::byte> _extent; // Single entry extents read when the archive is not mapped
+
+                WorkerContext() {
+                    _handlers.emplace("ZIPX", std::make_unique<zipx::ZipX>());
+                    _handlers.emplace("LZ2K", std::make_unique<lz2k::LZ2K>());
+                }
+            };
+            // State of one archive being extracted, kept alive by its pending tasks
+            struct ExtractionJob {
+                std::vector<EntryReport> _reports;
+                std::atomic<std::size_t> _remaining{0};
+                std::size_t _failures{0}; // Entries that reported an error
+                std::function<void()> _onComplete;
+                utils::Stats *_stats{nullptr};
+                ExtractionManifest *_manifest{nullptr};
+                DedupIndex *_dedup{nullptr};
+                std::uint32_t _archive{0}; // Id of the archive in the manifest
+                ReadPlan _plan; // Data of the files to extract, by ascending offset
+                ReadTracker _reads;
+            };
+            static constexpr std::size_t KEEP_BUFFER_SIZE = 64ull << 20; // Larger worker buffers are freed after use
+            static constexpr std::size_t STREAM_THRESHOLD = 8ull << 20; // Larger entries are decoded straight into their file
+
+            utils::BigEndianCursor _tocCursor() const noexcept { return utils::BigEndianCursor(_toc, _tocOffset); }
+            template <typename Record, typename Consumer>
+            void _decodeRecords(std::size_t offset, std::size_t count, Consumer &&consume) const;
+            std::size_t _entryDataSize(const FileInfo &fileInfo) const noexcept;
+            std::size_t _entryMemorySize(const FileInfo &fileInfo) const noexcept;
+            void _finishJob(ExtractionJob &job) const;
+            void _completeEntry(ExtractionJob &job) const;
+            void _extractExtent(const std::shared_ptr<ExtractionJob> &job, std::size_t extentIndex, Output &output, utils::MemoryBudget &budget) const;
+            void _extractEntry(const std::shared_ptr<ExtractionJob> &job, std::size_t fileIndex, std::span<const std::byte> stored, Output &output, utils::MemoryBudget &budget) const;
+            static WorkerContext &_workerContext();
+            const FileInfo *_findFile(std::string_view path) const;
+            ntt::BaseHandler *_findHandler(const FileInfo &fileInfo, std::span<const std::byte> data, WorkerContext &context, EntryReport &report) const;
+            std::span<const std::byte> _decodeFile(const FileInfo &fileInfo, std::span<const std::byte> stored, WorkerContext &context, EntryReport &report) const;
+            void _streamFile(const FileInfo &fileInfo, Output &output, WorkerContext &context, EntryReport &report) const;
+            void _extractFile(const FileInfo &fileInfo, std::span<const std::byte> stored, Output &output, EntryReport &report, std::function<void()> onWritten) const;
+            bool _linkDuplicate(const FileInfo &fileInfo, std::span<const std::byte> stored, Output &output, DedupIndex &dedup, EntryReport &report, std::optional<DedupIndex::Key> &firstCopy) const;
+            void _verifyFile(const FileInfo &fileInfo, WorkerContext &context, EntryReport &report) const;
+            void _reportOutput(const FileInfo &fileInfo, const Output::Result &result, std::size_t dataSize, EntryReport &report) const;
+            std::array<char, 4> _readCodec(const FileInfo &fileInfo, std::vector<std::byte> &scratch) const;
+            static ExtractionManifest::Record _manifestRecord(const FileInfo &fileInfo, std::uint32_t archive) noexcept;
     };
 
-    FilesChunk::FilesChunk(const std::vector<std::byte> &fileBuffer, const std::size_t &fileBufferSize) :
-        _fileBuffer(fileBuffer), _fileBufferSize(fileBufferSize), _headerOffset(0ull), _chunkSize(0u), _archiveRemainingSize(0u), _ChunkVersion(0u), _FileCount(0u), _DirCount(0u), _files({}), _filesChunkOffset(0ull), _crcDatabase({})
+    template <typename Visitor>
+    void FilesChunk::forEachEntry(Visitor &&visit) const
+    {
+        for (const FileInfo &file : _files) {
+            visit(EntryView{file._pathName, file._nameLength, file._isDir, file._CRC._dataAddr, file._CRC._fileZsize, file._CRC._fileSize, file._CRC._crcValue});
+        }
+    }
+
+    FilesChunk::FilesChunk(const ArchiveSource &source, spdlog::level::level_enum progressLevel) :
+        _source(source), _progressLevel(progressLevel), _fileBufferSize(source.getSize()), _tocScratch({}), _toc({}), _tocOffset(0ull), _headerOffset(0ull), _chunkSize(0u), _archiveRemainingSize(0u), _ChunkVersion(0u), _FileCount(0u), _DirCount(0u), _files({}), _filesChunkOffset(0ull), _crcDatabase({})
     {
     }
 
@@ -88,265 +260,894 @@ namespace ntt
         if (_headerOffset < 4 || _headerOffset > _fileBufferSize) {
             throw std::out_of_range("Invalid offset provided!");
         }
-        _archiveRemainingSize = utils::assignFromMemory(_archiveRemainingSize, _fileBuffer[_headerOffset - 0x4], sizeof(std::uint32_t), true);
-        _ChunkVersion = utils::assignFromMemory(_ChunkVersion, _fileBuffer[_headerOffset + 0xC], sizeof(std::uint32_t), true);
-        _FileCount = utils::assignFromMemory(_FileCount, _fileBuffer[_headerOffset + 0x10], sizeof(std::uint32_t), true);
-        _chunkSize = utils::assignFromMemory(_chunkSize, _fileBuffer[_headerOffset + 0x18], sizeof(std::uint32_t), true);
+
+        // The table of contents spans from the chunk header to the end of the archive.
+        // It is parsed in full, so ask for it to be paged in up front.
+        _tocOffset = _headerOffset - 0x4;
+        _source.advise(_tocOffset, _fileBufferSize - _tocOffset, ArchiveSource::Access::WillNeed);
+        _toc = _source.read(_tocOffset, _fileBufferSize - _tocOffset, _tocScratch);
+
+        const utils::BigEndianCursor toc = _tocCursor();
+        _archiveRemainingSize = toc.read<std::uint32_t>(_headerOffset - 0x4);
+        _ChunkVersion = toc.read<std::uint32_t>(_headerOffset + 0xC);
+        _FileCount = toc.read<std::uint32_t>(_headerOffset + 0x10);
+        _chunkSize = toc.read<std::uint32_t>(_headerOffset + 0x18);
     }
 
-    void FilesChunk::parseChunk()
+    // The whole range is checked before anything is decoded, so a truncated table throws before consume is ever called
+    template <typename Record, typename Consumer>
+    void FilesChunk::_decodeRecords(std::size_t offset, std::size_t count, Consumer &&consume) const
     {
-        std::uint32_t readIndex = 0u;
-        std::string fileName;
-        std::uint32_t fileIndex = 1u;
+        constexpr std::size_t recordSize = Record::WORDS * sizeof(std::uint32_t);
+        const utils::BigEndianCursor toc = _tocCursor();
+        toc.bytes(offset, count * recordSize);
 
-        std::uint32_t begDummyId = 0u;
-        std::uint32_t fileNameOffset = 1u;
-        std::uint16_t fileDirectoryId = 0u;
-        std::uint16_t someDummyId = 0u;
-        std::uint16_t someId = 0u;
-        std::uint16_t fileId = 0u;
-        std::uint32_t fileAddr = 0ull;
+        std::array<std::uint32_t, RECORD_BATCH * Record::WORDS> words;
+        for (std::size_t first = 0ull; first < count; first += RECORD_BATCH) {
+            const std::size_t batch = std::min(RECORD_BATCH, count - first);
+            utils::loadBigEndian32(toc, offset + first * recordSize, std::span<std::uint32_t>(words.data(), batch * Record::WORDS));
+            for (std::size_t index = 0ull; index < batch; ++index) {
+                consume(Record::decode(words.data() + index * Record::WORDS));
+            }
+        }
+    }
 
-        bool isDir = false;
+    // Names come first, NUL separated, then one record per name. The names are split with memchr into views of the table,
+    // then their records are decoded: an entry some other entry names as its parent is a directory, whatever its name.
+    // Only the entries nothing refers to, files and empty directories, are told apart by their name having a dot.
+    void FilesChunk::parseChunk()
+    {
+        if (_chunkSize < 0x2) {
+            throw std::out_of_range("Invalid name table size " + std::to_string(_chunkSize) + ".");
+        }
+        const std::size_t namesOffset = _headerOffset + 0x1C;
+        const std::span<const std::byte> nameTable = _tocCursor().bytes(namesOffset, _chunkSize - 0x2);
 
-        begDummyId = utils::assignFromMemory(begDummyId, _fileBuffer[_headerOffset + 0x1C + _chunkSize + (fileIndex * 0x4)], sizeof(std::uint32_t), false);
-        while (readIndex < _chunkSize - 0x2) {
-            if (static_cast<char>(_fileBuffer[_headerOffset + 0x1C + readIndex]) != '\0') {
-                fileName.push_back(static_cast<char>(_fileBuffer[_headerOffset + 0x1C + readIndex]));
+        std::vector<std::string_view> names;
+        names.reserve(_FileCount);
+        const char *name = reinterpret_cast<const char *>(nameTable.data());
+        const char *const tableEnd = name + nameTable.size();
+        while (name < tableEnd) {
+            const char *terminator = static_cast<const char *>(std::memchr(name, '\0', static_cast<std::size_t>(tableEnd - name)));
+            if (terminator == nullptr) {
+                break;
+            }
+            if (terminator != name) {
+                names.emplace_back(name, static_cast<std::size_t>(terminator - name));
             } else {
-                if (!fileName.empty()) {
-                    if (fileName.find('.') == std::string::npos) {
-                        isDir = true;
-                        fileAddr = 0x0u;
-                        _DirCount += 1u;
-                    }
-                    fileNameOffset = utils::assignFromMemory(fileNameOffset, _fileBuffer[_headerOffset + 0x1C + _chunkSize + (fileIndex * 0xC) + 0x4], sizeof(std::uint32_t), true);
-                    fileDirectoryId = utils::assignFromMemory(fileDirectoryId, _fileBuffer[_headerOffset + 0x1C + _chunkSize + (fileIndex * 0xC) + 0x8], sizeof(std::uint16_t), true);
-                    someDummyId = utils::assignFromMemory(someDummyId, _fileBuffer[_headerOffset + 0x1C + _chunkSize + (fileIndex * 0xC) + 0xA], sizeof(std::uint16_t), true);
-                    someId = utils::assignFromMemory(someId, _fileBuffer[_headerOffset + 0x1C + _chunkSize + (fileIndex * 0xC) + 0xC], sizeof(std::uint16_t), true);
-                    fileId = utils::assignFromMemory(fileId, _fileBuffer[_headerOffset + 0x1C + _chunkSize + (fileIndex * 0xC) + 0xE], sizeof(std::uint16_t), true);
-
-                    addFile(isDir, fileDirectoryId, fileIndex, fileName, fileAddr);
-                    fileName.clear();
-                    fileIndex += 1;
-                } else {
-                    spdlog::warn("The file name was empty");
-                }
-                readIndex += 0x1;
+                spdlog::warn("The file name was empty");
             }
-            readIndex += 0x1;
-            isDir = false;
+            name = terminator + 0x2; // A byte follows every terminator
         }
-        spdlog::info("Found {} files", _FileCount);
+
+        // Entry ids are the position of the name in the table, starting at 1
+        std::vector<std::uint16_t> parentIds;
+        std::vector<bool> isParent(names.size(), false);
+        parentIds.reserve(names.size());
+        _decodeRecords<NameRecord>(namesOffset + _chunkSize + 0x10, names.size(), [&](const NameRecord &record) {
+            parentIds.push_back(record._parentId);
+            if (record._parentId != 0 && record._parentId <= names.size()) {
+                isParent[record._parentId - 1u] = true;
+            }
+        });
+
+        _files.reserve(names.size());
+        for (std::size_t nameIndex = 0ull; nameIndex < names.size(); ++nameIndex) {
+            const bool isDir = isParent[nameIndex] || names[nameIndex].find('.') == std::string_view::npos;
+            if (isDir) {
+                _DirCount += 1u;
+            }
+            addFile(isDir, parentIds[nameIndex], static_cast<std::uint16_t>(nameIndex + 1), names[nameIndex], 0x0u);
+        }
+        _entryIndexById = {};
+        if (_files.size() - _DirCount != _FileCount) {
+            spdlog::warn("The table holds {} files but {} of its entries are not directories.", _FileCount, _files.size() - _DirCount);
+        }
+        spdlog::log(_progressLevel, "Found {} files", _FileCount);
     }
 
+    // Data records only exist for files, the header's count of them after a name record per entry.
+    // They are kept by record number: computeCRC() hands them to the files by the hash of their path,
+    // so the layout does not depend on which entries were taken for directories.
     void FilesChunk::getFilesOffset()
     {
-        _filesChunkOffset = _headerOffset + 0x1C + _chunkSize + 0x10 + 0xC * (_FileCount + _DirCount);
-        std::size_t fileOffset = 0ull;
-        CRCInfo crc = {};
-
-        std::uint32_t typeBOH = 0u;
-        std::uint32_t fileCount2 = 0u; // Data from the archive
+        _filesChunkOffset = _headerOffset + 0x1C + _chunkSize + 0x10 + 0xC * _files.size();
+        const utils::BigEndianCursor toc = _tocCursor();
 
-        typeBOH = utils::assignFromMemory(typeBOH, _fileBuffer[_filesChunkOffset], sizeof(std::uint32_t), true);
-        fileCount2 = utils::assignFromMemory(fileCount2, _fileBuffer[_filesChunkOffset + 0x4], sizeof(std::uint32_t), true);
+        const std::uint32_t fileCount2 = toc.read<std::uint32_t>(_filesChunkOffset + 0x4); // Data from the archive, after an unknown word
 
         if (_FileCount != fileCount2)
-            spdlog::warn("The number of files read from the archive differ from last check.");
+            spdlog::warn("The data table holds {} records but the header announces {} files.", fileCount2, _FileCount);
 
-        for (std::size_t fileIndex = 0ull; fileIndex < _FileCount + _DirCount; ++fileIndex)
-        {
-            crc = {};
-            if (!_files[fileIndex]._isDir) {
-                crc._packedVer = utils::assignFromMemory(crc._packedVer, _fileBuffer[_filesChunkOffset + 0x8 + (fileOffset * 0x10)], sizeof(std::uint32_t), true);
-                crc._dataAddr = utils::assignFromMemory(crc._dataAddr, _fileBuffer[_filesChunkOffset + 0xC + (fileOffset * 0x10)], sizeof(std::uint32_t), true);
-                crc._fileZsize = utils::assignFromMemory(crc._fileZsize, _fileBuffer[_filesChunkOffset + 0x10 + (fileOffset * 0x10)], sizeof(std::uint32_t), true);
-                crc._fileSize = utils::assignFromMemory(crc._fileSize, _fileBuffer[_filesChunkOffset + 0x14 + (fileOffset * 0x10)], sizeof(std::uint32_t), true);
-                fileOffset += 1;
+        _CRCs.reserve(_FileCount);
+        _decodeRecords<DataRecord>(_filesChunkOffset + 0x8, _FileCount, [&](const DataRecord &record) {
+            _CRCs.push_back({record._dataAddr, record._fileSize, record._fileZsize, record._packedVer, 0u});
+        });
+    }
+
+    // Entries refer to their parent by its 16 bits id, so the full path of an entry is its
+    // parent's cached path plus its own name: a single lookup instead of a walk up the tree.
+    void FilesChunk::addFile(bool isDir, const std::uint16_t parentId, const std::uint16_t id, std::string_view fileName, const std::uint32_t addr)
+    {
+        std::string pathName;
+
+        if (_entryIndexById.empty()) {
+            _entryIndexById.assign(0x10000, NO_ENTRY);
+            for (std::size_t fileIndex = 0ull; fileIndex < _files.size(); ++fileIndex) {
+                std::uint32_t &slot = _entryIndexById[_files[fileIndex]._dirId];
+                if (slot == NO_ENTRY) {
+                    slot = static_cast<std::uint32_t>(fileIndex);
+                }
             }
-            _CRCs.push_back(crc);
         }
+
+        if (parentId != 0 && _entryIndexById[parentId] != NO_ENTRY) {
+            const std::string &parentPath = _files[_entryIndexById[parentId]]._pathName;
+            pathName.reserve(parentPath.size() + 1 + fileName.size());
+            pathName.append(parentPath).append(1, '/');
+        }
+        pathName += fileName;
+
+        // Ids wrap past 65535 entries, the first entry holding an id stays its owner
+        if (_entryIndexById[id] == NO_ENTRY) {
+            _entryIndexById[id] = static_cast<std::uint32_t>(_files.size());
+        }
+        _files.push_back({isDir, parentId, id, std::move(pathName), static_cast<std::uint32_t>(fileName.size()), {}, false});
     }
 
-    void FilesChunk::addFile(bool isDir, const std::uint16_t parentId, const std::uint16_t id, const std::string &fileName, const std::uint32_t addr)
+    void FilesChunk::_reportOutput(const FileInfo &fileInfo, const Output::Result &result, std::size_t dataSize, EntryReport &report) const
     {
-        std::string pathName;
-        std::uint16_t currentParentId = parentId;
-        std::vector<std::string> pathComponents;
+        // A directory already there, from an earlier run or another archive, is what extraction wants
+        if (result._status == Output::Status::AlreadyExists && fileInfo._isDir) {
+            report.add(spdlog::level::debug, "Already exists: {}", result._path);
+            return;
+        } else if (result._status == Output::Status::AlreadyExists) {
+            report.add(spdlog::level::warn, "Already exists: {}", result._path);
+            return;
+        } else if (result._status == Output::Status::Failed) {
+            report.add(spdlog::level::err, "{}", result._error);
+            return;
+        } else if (fileInfo._isDir) {
+            return;
+        }
 
-        while (currentParentId != 0) {
-            auto it = std::find_if(_files.begin(), _files.end(), [currentParentId](const FileInfo &file) {
-                return file._dirId == currentParentId;
-            });
+        report._written = true;
+        if (dataSize != 0) {
+            report.add(spdlog::level::info, "{:08x} {:<8} {} {}", fileInfo._CRC._dataAddr, fileInfo._CRC._fileZsize, fileInfo._CRC._fileSize, fileInfo._pathName);
+        } else {
+            report.add(spdlog::level::warn, "{:08x} {:<8} {}", fileInfo._CRC._dataAddr, 0, fileInfo._pathName);
+        }
+    }
+
+    ExtractionManifest::Record FilesChunk::_manifestRecord(const FileInfo &fileInfo, std::uint32_t archive) noexcept
+    {
+        return {archive, fileInfo._CRC._crcValue, fileInfo._CRC._fileZsize, fileInfo._CRC._fileSize, fileInfo._CRC._dataAddr};
+    }
+
+    void FilesChunk::defineCRCdatabase()
+    {
+        const std::size_t chunkOffset = _filesChunkOffset + (_FileCount * 0x10) + 0x8;
+
+        // One CRC per data record, in the same order
+        _crcDatabase.reserve(_FileCount);
+        _decodeRecords<CrcRecord>(chunkOffset, _FileCount, [&](const CrcRecord &record) {
+            _crcDatabase.push_back(record._crcValue);
+        });
+    }
+
+    // Every entry is hashed once, then looked up in a CRC-sorted index of the table instead of scanning it.
+    // Equal CRCs in the table are handed out in order, so each record is claimed by at most one entry.
+    void FilesChunk::computeCRC() // FNV-a1
+    {
+        std::vector<std::pair<std::uint32_t, std::uint32_t>> crcIndex; // (crc, record)
+        crcIndex.reserve(_crcDatabase.size());
+        for (std::uint32_t recordIndex = 0u; recordIndex < _crcDatabase.size() && recordIndex < _CRCs.size(); ++recordIndex) {
+            crcIndex.emplace_back(_crcDatabase[recordIndex], recordIndex);
+        }
+        std::sort(crcIndex.begin(), crcIndex.end());
+        for (std::size_t i = 1ull; i < crcIndex.size(); ++i) {
+            if (crcIndex[i].first == crcIndex[i - 1].first && (i < 2 || crcIndex[i - 2].first != crcIndex[i].first)) {
+                spdlog::warn("The CRC {:08x} appears more than once in the archive table.", crcIndex[i].first);
+            }
+        }
+
+        std::vector<std::uint32_t> entries;
+        std::vector<std::string_view> paths;
+        entries.reserve(_FileCount);
+        paths.reserve(_FileCount);
+        for (std::uint32_t fileIndex = 0u; fileIndex < _files.size(); ++fileIndex) {
+            if (!_files[fileIndex]._isDir) {
+                entries.push_back(fileIndex);
+                paths.push_back(_files[fileIndex]._pathName);
+            }
+        }
+        std::vector<std::uint32_t> hashes(paths.size());
+        utils::pathHashBatch(paths, hashes);
+
+        _pathIndex.clear();
+        _pathIndex.reserve(entries.size());
+        for (std::size_t entry = 0ull; entry < entries.size(); ++entry) {
+            _pathIndex.emplace_back(hashes[entry], entries[entry]);
+        }
+        std::sort(_pathIndex.begin(), _pathIndex.end());
+
+        std::vector<std::uint32_t> claimedBy(crcIndex.size(), NO_ENTRY); // By record
+        for (std::size_t entry = 0ull; entry < entries.size(); ++entry) {
+            FileInfo &file = _files[entries[entry]];
+            const std::uint32_t crc = hashes[entry];
+            auto [first, last] = std::equal_range(crcIndex.begin(), crcIndex.end(), std::make_pair(crc, 0u),
+                [](const auto &lhs, const auto &rhs) { return lhs.first < rhs.first; });
+            if (first == last) {
+                spdlog::warn("The CRC of the file {} has not been found.", file._pathName);
+                continue;
+            }
 
-            if (it != _files.end()) {
-                pathComponents.push_back(it->_fileName);
-                currentParentId = it->_parentDirId;
+            auto slot = std::find_if(first, last, [&claimedBy](const auto &record) { return claimedBy[record.second] == NO_ENTRY; });
+            if (slot == last) {
+                slot = first;
+                spdlog::warn("The CRC {:08x} of the file {} collides with {}.", crc, file._pathName, _files[claimedBy[slot->second]]._pathName);
             } else {
-                break;
+                claimedBy[slot->second] = entries[entry];
+                file._crcMatched = true;
             }
+
+            const CRCInfo &record = _CRCs[slot->second];
+            file._CRC._crcValue = crc;
+            file._CRC._packedVer = record._packedVer;
+            file._CRC._dataAddr = record._dataAddr;
+            file._CRC._fileZsize = record._fileZsize;
+            file._CRC._fileSize = record._fileSize;
         }
-        std::reverse(pathComponents.begin(), pathComponents.end());
-        for (const auto& component : pathComponents) {
-            pathName += component + "/";
+    }
+
+    std::size_t FilesChunk::_entryDataSize(const FileInfo &fileInfo) const noexcept
+    {
+        if (fileInfo._CRC._fileSize != fileInfo._CRC._fileZsize) { // File is compressed
+            return fileInfo._CRC._fileZsize;
         }
-        pathName += fileName;
-        _files.push_back({isDir, parentId, id, pathName, fileName, {}, {}});
+        return fileInfo._CRC._fileSize;
     }
 
-    void FilesChunk::_createFile(FileInfo &fileInfo) const
+    // Entries are not copied anymore: this only checks that every data range lies inside the archive.
+    // The kernel is told how the data will be read once the entries are scheduled.
+    void FilesChunk::readFilesOffsetBuffer()
     {
-        std::string relativePath = "./Content/" + fileInfo._pathName;
+        for (FileInfo &file : _files) {
+            file._hasData = false;
+            if (!file._isDir) {
+                const std::size_t dataSize = _entryDataSize(file);
+                if (file._CRC._dataAddr > _fileBufferSize || dataSize > _fileBufferSize - file._CRC._dataAddr) {
+                    spdlog::error("Data of {} is out of the archive bounds ({:08x} + {}).", file._pathName, file._CRC._dataAddr, dataSize);
+                    continue;
+                }
+                file._hasData = true;
+            }
+        }
+    }
 
-        if (std::filesystem::exists(relativePath)) {
-            spdlog::warn("Already exists: {}", relativePath);
+    FilesChunk::WorkerContext &FilesChunk::_workerContext()
+    {
+        thread_local WorkerContext context;
+        return context;
+    }
+
+    // Returns the entry data from its stored bytes, decompressed into the context buffers when needed.
+    // Entries that cannot be decompressed are returned as stored, with the reason in the report.
+    std::span<const std::byte> FilesChunk::_decodeFile(const FileInfo &file, std::span<const std::byte> stored, WorkerContext &context, EntryReport &report) const
+    {
+        const auto start = std::chrono::steady_clock::now();
+        std::span<const std::byte> data = stored;
+
+        report._codec = "stored";
+        if (ntt::BaseHandler *handler = _findHandler(file, data, context, report)) {
+            context._output.resize(file._CRC._fileSize);
+            try {
+                handler->handle(data, context._output);
+                data = context._output;
+            } catch (const std::runtime_error &e) {
+                report.add(spdlog::level::err, "Could not decompress {}: {}", file._pathName, e.what());
+            }
+        }
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        report._decode = {elapsed.count(), file._hasData ? _entryDataSize(file) : 0ull, data.size(), 1ull};
+        return data;
+    }
+
+    // The codec of a compressed entry, from the signature of its first chunk
+    ntt::BaseHandler *FilesChunk::_findHandler(const FileInfo &file, std::span<const std::byte> data, WorkerContext &context, EntryReport &report) const
+    {
+        if (file._isDir || file._CRC._fileSize == file._CRC._fileZsize) {
+            return nullptr;
+        }
+        if (data.size() < 4ull) {
+            report.add(spdlog::level::warn, "File {} has insufficient data for signature extraction", file.fileName());
+            return nullptr;
+        }
+
+        std::string fileSign(reinterpret_cast<const char*>(data.data()), 4);
+        auto it = context._handlers.find(fileSign);
+        if (it == context._handlers.end()) {
+            report.add(spdlog::level::warn, "{} with signature {} is unknown.", file.fileName(), fileSign);
+            return nullptr;
+        }
+        report._codec = it->first;
+        return it->second.get();
+    }
+
+    // Large entries are decoded window by window into their file, so a worker holds at most one window of output.
+    // Stored entries are copied the same way, which also bounds the read buffer when the archive is not mapped.
+    // Its decode time includes the writes, which happen as the output is produced.
+    void FilesChunk::_streamFile(const FileInfo &file, Output &output, WorkerContext &context, EntryReport &report) const
+    {
+        const auto start = std::chrono::steady_clock::now();
+        std::unique_ptr<Output::Stream> stream;
+        Output::Result result = output.openStream(file._pathName, file._CRC._fileSize, stream);
+        if (result._status != Output::Status::Written) {
+            _reportOutput(file, result, 0ull, report);
             return;
         }
 
-        if (fileInfo._isDir) {
-            std::error_code errCode;
-            if (!std::filesystem::create_directories(relativePath, errCode)) {
-                spdlog::error("Could not create directories for {}: {}", fileInfo._pathName, errCode.message());
+        bool decoded = false;
+        report._codec = "stored";
+        if (file._hasData && file._CRC._fileSize != file._CRC._fileZsize) {
+            std::span<const std::byte> data = _source.read(file._CRC._dataAddr, _entryDataSize(file), context._scratch);
+            if (ntt::BaseHandler *handler = _findHandler(file, data, context, report)) {
+                try {
+                    handler->handleStream(data, file._CRC._fileSize, [&stream](std::span<const std::byte> chunk) { stream->write(chunk); });
+                    decoded = true;
+                } catch (const std::runtime_error &e) {
+                    report.add(spdlog::level::err, "Could not decompress {}: {}", file._pathName, e.what());
+                    stream->rewind();
+                }
+            }
+        }
+
+        const std::size_t dataSize = file._hasData ? (decoded ? file._CRC._fileSize : _entryDataSize(file)) : 0ull;
+        if (!decoded) {
+            for (std::size_t offset = 0ull; offset < dataSize; offset += ntt::BaseHandler::STREAM_WINDOW) {
+                stream->write(_source.read(file._CRC._dataAddr + offset, std::min(ntt::BaseHandler::STREAM_WINDOW, dataSize - offset), context._scratch));
             }
+        }
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        report._decode = {elapsed.count(), file._hasData ? _entryDataSize(file) : 0ull, dataSize, 1ull};
+        _reportOutput(file, stream->close(), dataSize, report);
+    }
+
+    // The decoded buffer is handed over to the output along with the data, and replaced by a recycled one.
+    // Stored data read into the extent buffer is copied out, unless the entry is all the extent holds.
+    // Large entries read their data themselves, stored is empty for them.
+    void FilesChunk::_extractFile(const FileInfo &file, std::span<const std::byte> stored, Output &output, EntryReport &report, std::function<void()> onWritten) const
+    {
+        WorkerContext &context = _workerContext();
+
+        if (file._CRC._fileSize > STREAM_THRESHOLD) {
+            _streamFile(file, output, context, report);
+            onWritten();
         } else {
-            std::error_code errCode;
-            auto parentPath = std::filesystem::path(relativePath).parent_path();
-            if (!parentPath.empty() && !std::filesystem::exists(parentPath)) {
-                if (!std::filesystem::create_directories(parentPath, errCode)) {
-                    spdlog::error("Could not create parent directories for file {}: {}", fileInfo._pathName, errCode.message());
-                    return;
-                }
+            std::span<const std::byte> data = _decodeFile(file, stored, context, report);
+            std::vector<std::byte> owned;
+
+            if (!data.empty() && data.data() == context._output.data()) {
+                owned = std::move(context._output);
+                context._output = output.takeBuffer();
+            } else if (!data.empty() && data.data() == context._extent.data() && data.size() == context._extent.size()) {
+                owned = std::move(context._extent);
+                context._extent = output.takeBuffer();
+            } else if (!data.empty() && !_source.isMapped()) {
+                owned = output.takeBuffer();
+                owned.assign(data.begin(), data.end());
+                data = owned;
             }
+            output.write(file._pathName, data, std::move(owned), [this, &file, &report, dataSize = data.size(), onWritten = std::move(onWritten)](const Output::Result &result) {
+                _reportOutput(file, result, dataSize, report);
+                onWritten();
+            });
+        }
 
-            std::ofstream file(relativePath, std::ios::out | std::ios::binary);
-            if (!file) {
-                spdlog::error("Failed to create file: {}", relativePath);
-            } else {
-                if (!fileInfo._dataBuffer.empty()) {
-                    file.write(reinterpret_cast<const char *>(fileInfo._dataBuffer.data()), fileInfo._dataBuffer.size());
-                    if (!file) {
-                        spdlog::error("Failed to write data to file: {}", relativePath);
-                    } else {
-                        spdlog::info("{:08x} {:<8} {} {}", fileInfo._CRC._dataAddr, fileInfo._CRC._fileZsize, fileInfo._CRC._fileSize, fileInfo._pathName);
-                    }
+        if (context._output.capacity() > KEEP_BUFFER_SIZE) {
+            context._output = {};
+        }
+        if (context._scratch.capacity() > KEEP_BUFFER_SIZE) {
+            context._scratch = {};
+        }
+        if (context._extent.capacity() > KEEP_BUFFER_SIZE) {
+            context._extent = {};
+        }
+    }
+
+    const FilesChunk::FileInfo *FilesChunk::_findFile(std::string_view path) const
+    {
+        const std::uint32_t hash = utils::pathHash(path);
+        auto it = std::lower_bound(_pathIndex.begin(), _pathIndex.end(), std::make_pair(hash, 0u));
+        for (; it != _pathIndex.end() && it->first == hash; ++it) {
+            if (utils::pathEquals(_files[it->second]._pathName, path)) {
+                return &_files[it->second];
+            }
+        }
+        return nullptr;
+    }
+
+    // Reads and decompresses a single entry, looked up by path like the archive does (case and separator insensitive)
+    std::vector<std::byte> FilesChunk::extract(std::string_view path) const
+    {
+        const FileInfo *file = _findFile(path);
+        if (file == nullptr) {
+            throw std::out_of_range("No entry named " + std::string(path));
+        }
+        FileInfo entry = *file;
+        const std::size_t dataSize = _entryDataSize(entry);
+        if (entry._CRC._dataAddr > _fileBufferSize || dataSize > _fileBufferSize - entry._CRC._dataAddr) {
+            throw std::out_of_range("Data of " + entry._pathName + " is out of the archive bounds");
+        }
+        entry._hasData = true;
+
+        EntryReport report;
+        WorkerContext &context = _workerContext();
+        std::span<const std::byte> data = _decodeFile(entry, _source.read(entry._CRC._dataAddr, dataSize, context._scratch), context, report);
+        for (const auto &[level, line] : report._lines) {
+            if (level >= spdlog::level::err) {
+                throw std::runtime_error(line);
+            }
+            spdlog::log(level, line);
+        }
+        return {data.begin(), data.end()};
+    }
+
+    // Large entries are decoded window by window like when they are streamed, and the windows dropped
+    void FilesChunk::_verifyFile(const FileInfo &file, WorkerContext &context, EntryReport &report) const
+    {
+        if (!file._crcMatched) {
+            report.add(spdlog::level::err, "{} has no CRC record of its own in the archive table", file._pathName);
+        }
+        const std::size_t dataSize = _entryDataSize(file);
+        if (file._CRC._dataAddr > _fileBufferSize || dataSize > _fileBufferSize - file._CRC._dataAddr) {
+            report.add(spdlog::level::err, "Data of {} is out of the archive bounds ({:08x} + {}).", file._pathName, file._CRC._dataAddr, dataSize);
+            return;
+        }
+
+        const auto start = std::chrono::steady_clock::now();
+        std::span<const std::byte> data = _source.read(file._CRC._dataAddr, dataSize, context._scratch);
+        std::size_t decodedSize = data.size();
+        report._codec = "stored";
+        if (file._CRC._fileSize != file._CRC._fileZsize) {
+            ntt::BaseHandler *handler = _findHandler(file, data, context, report);
+            if (handler == nullptr) {
+                report.add(spdlog::level::err, "Could not decompress {}: no codec for its data", file._pathName);
+                return;
+            }
+            try {
+                if (file._CRC._fileSize > STREAM_THRESHOLD) {
+                    decodedSize = 0ull;
+                    handler->handleStream(data, file._CRC._fileSize, [&decodedSize](std::span<const std::byte> chunk) { decodedSize += chunk.size(); });
                 } else {
-                    spdlog::warn("{:08x} {:<8} {}", fileInfo._CRC._dataAddr, 0, fileInfo._pathName);
+                    context._output.resize(file._CRC._fileSize);
+                    handler->handle(data, context._output);
+                    decodedSize = context._output.size();
                 }
-                file.close();
+            } catch (const std::runtime_error &e) {
+                report.add(spdlog::level::err, "Could not decompress {}: {}", file._pathName, e.what());
+                return;
             }
         }
+        if (decodedSize != file._CRC._fileSize) {
+            report.add(spdlog::level::err, "{} decoded to {} bytes instead of {}", file._pathName, decodedSize, file._CRC._fileSize);
+        }
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        report._decode = {elapsed.count(), dataSize, decodedSize, 1ull};
     }
 
-    void FilesChunk::defineCRCdatabase()
+    std::size_t FilesChunk::verifyFiles(utils::ThreadPool &pool, const utils::PathFilter &filter, utils::Stats *stats)
     {
-        std::size_t chunkOffset = _filesChunkOffset + (_FileCount * 0x10) + 0x8;
-        std::uint32_t crc = 0u;
-        std::uint32_t fileOffset = 0u;
+        auto job = std::make_shared<ExtractionJob>();
+        auto done = std::make_shared<std::promise<void>>();
+        std::future<void> finished = done->get_future();
+        job->_reports.resize(_files.size());
+        job->_onComplete = [done]() { done->set_value(); };
+        job->_stats = stats;
 
-        for (std::uint32_t fileIndex = 0ull; fileIndex < _FileCount + _DirCount; ++fileIndex)
-        {
-            crc = 0xFFFFFFFF;
-            if (!_files[fileIndex]._isDir) {
-                crc = utils::assignFromMemory(crc, _fileBuffer[chunkOffset + fileOffset * 0x4], sizeof(std::uint32_t), true);
-                fileOffset += 1;
+        std::vector<std::size_t> order;
+        for (std::size_t fileIndex = 0ull; fileIndex < _files.size(); ++fileIndex) {
+            if (!_files[fileIndex]._isDir && filter.matches(_files[fileIndex]._pathName)) {
+                order.push_back(fileIndex);
             }
-            _crcDatabase.push_back(crc);
         }
+        if (order.empty()) {
+            _finishJob(*job);
+            return 0ull;
+        }
+
+        _source.advise(0, _fileBufferSize, ArchiveSource::Access::Sequential);
+        job->_remaining = order.size();
+        for (std::size_t fileIndex : order) {
+            pool.submit([this, fileIndex, job](std::size_t) {
+                WorkerContext &context = _workerContext();
+                try {
+                    _verifyFile(_files[fileIndex], context, job->_reports[fileIndex]);
+                } catch (const std::exception &e) {
+                    job->_reports[fileIndex].add(spdlog::level::err, "Could not verify {}: {}", _files[fileIndex]._pathName, e.what());
+                }
+                if (context._output.capacity() > KEEP_BUFFER_SIZE) {
+                    context._output = {};
+                }
+                if (context._scratch.capacity() > KEEP_BUFFER_SIZE) {
+                    context._scratch = {};
+                }
+                if (job->_remaining.fetch_sub(1) == 1) {
+                    _finishJob(*job);
+                }
+            });
+        }
+        finished.wait();
+        spdlog::info("Verified {} files, {} failed", order.size(), job->_failures);
+        return job->_failures;
     }
 
-    std::string FilesChunk::_normalizeFilename(const std::string &fullname) const {
-        std::string normalized = fullname;
+    // Bytes held while the entry is decoded: the output buffer, plus the read buffer when the archive is not mapped.
+    // Streamed entries only hold a window of output.
+    std::size_t FilesChunk::_entryMemorySize(const FileInfo &fileInfo) const noexcept
+    {
+        if (fileInfo._CRC._fileSize > STREAM_THRESHOLD) {
+            const bool compressed = fileInfo._CRC._fileSize != fileInfo._CRC._fileZsize;
+            return (_source.isMapped() || !compressed ? 0ull : _entryDataSize(fileInfo)) + 2 * ntt::BaseHandler::STREAM_WINDOW;
+        }
+        std::size_t size = _source.isMapped() ? 0ull : _entryDataSize(fileInfo);
+        if (fileInfo._CRC._fileSize != fileInfo._CRC._fileZsize) {
+            size += fileInfo._CRC._fileSize;
+        }
+        return size;
+    }
+
+    // Only the 4 bytes holding the codec signature of compressed entries are read
+    std::vector<FilesChunk::EntryListing> FilesChunk::listFiles(const utils::PathFilter &filter) const
+    {
+        std::vector<EntryListing> listing;
+        std::vector<std::byte> scratch;
 
-        std::transform(normalized.begin(), normalized.end(), normalized.begin(), [](char c) {
-            if (c == '/') {
-                return '\\';
+        listing.reserve(_FileCount);
+        for (const FileInfo &file : _files) {
+            if (file._isDir || !filter.matches(file._pathName)) {
+                continue;
             }
-            return static_cast<char>(std::toupper(c));
-        });
+            EntryListing entry{file._pathName, file._CRC._dataAddr, file._CRC._fileZsize, file._CRC._fileSize, "stored"};
+            if (file._CRC._fileSize != file._CRC._fileZsize) {
+                const std::array<char, 4> sign = file._codec != std::array<char, 4>{} ? file._codec : _readCodec(file, scratch);
+                entry._codec = "?";
+                if (sign != std::array<char, 4>{}) {
+                    entry._codec.clear();
+                    for (const char c : sign) {
+                        entry._codec.push_back(c >= 0x20 && c < 0x7F ? c : '.');
+                    }
+                }
+            }
+            listing.push_back(std::move(entry));
+        }
+        return listing;
+    }
 
-        return normalized;
+    // Zeros when the signature lies outside of the archive
+    std::array<char, 4> FilesChunk::_readCodec(const FileInfo &file, std::vector<std::byte> &scratch) const
+    {
+        std::array<char, 4> sign{};
+        if (file._CRC._fileZsize >= 4 && file._CRC._dataAddr + 4ull <= _fileBufferSize) {
+            std::memcpy(sign.data(), _source.read(file._CRC._dataAddr, 4, scratch).data(), sign.size());
+        }
+        return sign;
     }
 
-    void FilesChunk::computeCRC() // FNV-a1
+    bool FilesChunk::loadIndex(const IndexFile &index)
     {
-        const std::uint32_t CRC_FNV_OFFSET = 0x811c9dc5;
-        const std::uint32_t CRC_FNV_PRIME = 0x199933;
-        std::uint32_t crc = CRC_FNV_OFFSET;
-        std::ptrdiff_t idx = 0;
-        std::string normalizedPath;
-        CRCInfo crcData = {};
-
-        for (std::uint32_t fileIndex = 0ull; fileIndex < _FileCount + _DirCount; ++fileIndex)
-        {
-            crc = CRC_FNV_OFFSET;
-            normalizedPath.clear();
-            if (!_files[fileIndex]._isDir && _crcDatabase[fileIndex] != 0xFFFFFFFF) {
-                normalizedPath = _normalizeFilename(_files[fileIndex]._pathName);
-                for (char c : normalizedPath) {
-                    crc ^= static_cast<std::uint8_t>(c);
-                    crc *= CRC_FNV_PRIME;
+        const IndexFile::Header &header = index.getHeader();
+        std::vector<FileInfo> files;
+        std::vector<std::pair<std::uint32_t, std::uint32_t>> pathIndex;
+
+        try {
+            files.reserve(header._entryCount);
+            for (std::size_t entryIndex = 0ull; entryIndex < header._entryCount; ++entryIndex) {
+                const IndexFile::Entry entry = index.getEntry(entryIndex);
+                const std::string_view path = index.getString(entry._pathOffset, entry._pathLength);
+                if (entry._nameLength > path.size()) {
+                    return false;
                 }
+                FileInfo &file = files.emplace_back(FileInfo{entry._isDir != 0, entry._parentDirId, entry._dirId, std::string(path),
+                    entry._nameLength, {entry._dataAddr, entry._fileSize, entry._fileZsize, entry._packedVer, entry._crcValue}, false});
+                std::memcpy(file._codec.data(), entry._codec, file._codec.size());
+            }
 
-                auto it = std::find(_crcDatabase.begin(), _crcDatabase.end(), crc);
-                if (it != _crcDatabase.end()) {
-                    idx = std::distance(_crcDatabase.begin(), it);
-                    crcData._crcValue = crc;
-                    crcData._crcPath = normalizedPath;
-                    crcData._dataAddr = _CRCs[idx]._dataAddr;
-                    crcData._fileZsize = _CRCs[idx]._fileZsize;
-                    crcData._fileSize = _CRCs[idx]._fileSize;
-                    crcData._dataAddr = _CRCs[idx]._dataAddr;
-                    _files[fileIndex]._CRC = crcData;
-                } else {
-                    spdlog::warn("The CRC of the file {} has not been found.", _files[fileIndex]._pathName);
+            pathIndex.reserve(header._fileCount);
+            for (std::size_t slotIndex = 0ull; slotIndex < header._fileCount; ++slotIndex) {
+                const IndexFile::PathSlot slot = index.getPathSlot(slotIndex);
+                if (slot._fileIndex >= files.size()) {
+                    return false;
                 }
+                pathIndex.emplace_back(slot._hash, slot._fileIndex);
             }
+        } catch (const std::out_of_range &) {
+            return false;
+        }
+        if (!std::is_sorted(pathIndex.begin(), pathIndex.end())) {
+            return false;
         }
+
+        _headerOffset = header._headerOffset;
+        _ChunkVersion = header._chunkVersion;
+        _FileCount = header._fileCount;
+        _DirCount = header._dirCount;
+        _files = std::move(files);
+        _pathIndex = std::move(pathIndex);
+        return true;
     }
 
-    void FilesChunk::readFilesOffsetBuffer()
+    // Compressed entries have their signature read once here, so that listings from the index do not touch the data
+    void FilesChunk::saveIndex(const std::string &indexPath) const
     {
-        for (FileInfo &file : _files) {
-            if (!file._isDir) {
-                if (file._CRC._fileSize != file._CRC._fileZsize) { // File is compressed
-                    file._dataBuffer.resize(file._CRC._fileZsize);
-                    std::memcpy(file._dataBuffer.data(), &_fileBuffer[file._CRC._dataAddr], static_cast<std::size_t>(file._CRC._fileZsize));
-                } else {
-                    file._dataBuffer.resize(file._CRC._fileSize);
-                    std::memcpy(file._dataBuffer.data(), &_fileBuffer[file._CRC._dataAddr], static_cast<std::size_t>(file._CRC._fileSize));
+        IndexFile::Header header{};
+        std::memcpy(header._magic, IndexFile::MAGIC, sizeof(header._magic));
+        header._version = IndexFile::VERSION;
+        header._byteOrder = IndexFile::BYTE_ORDER_MARK;
+        header._archiveSize = _fileBufferSize;
+        header._modificationTime = _source.getModificationTime();
+        header._headerOffset = _headerOffset;
+        header._archiveHash = IndexFile::hashArchive(_source, _headerOffset);
+        header._entryCount = static_cast<std::uint32_t>(_files.size());
+        header._fileCount = static_cast<std::uint32_t>(_pathIndex.size());
+        header._dirCount = _DirCount;
+        header._chunkVersion = _ChunkVersion;
+
+        std::vector<IndexFile::Entry> entries;
+        std::string strings;
+        std::vector<std::byte> scratch;
+        entries.reserve(_files.size());
+        for (const FileInfo &file : _files) {
+            IndexFile::Entry entry{};
+            entry._pathOffset = static_cast<std::uint32_t>(strings.size());
+            entry._pathLength = static_cast<std::uint32_t>(file._pathName.size());
+            entry._nameLength = file._nameLength;
+            entry._dataAddr = file._CRC._dataAddr;
+            entry._fileSize = file._CRC._fileSize;
+            entry._fileZsize = file._CRC._fileZsize;
+            entry._packedVer = file._CRC._packedVer;
+            entry._crcValue = file._CRC._crcValue;
+            entry._parentDirId = file._parentDirId;
+            entry._dirId = file._dirId;
+            entry._isDir = file._isDir ? 1 : 0;
+            if (!file._isDir && file._CRC._fileSize != file._CRC._fileZsize) {
+                const std::array<char, 4> sign = file._codec != std::array<char, 4>{} ? file._codec : _readCodec(file, scratch);
+                std::memcpy(entry._codec, sign.data(), sign.size());
+            }
+            strings += file._pathName;
+            entries.push_back(entry);
+        }
+
+        std::vector<IndexFile::PathSlot> pathIndex;
+        pathIndex.reserve(_pathIndex.size());
+        for (const auto &[hash, fileIndex] : _pathIndex) {
+            pathIndex.push_back({hash, fileIndex});
+        }
+        header._stringsSize = strings.size();
+        IndexFile::write(indexPath, header, entries, pathIndex, strings);
+    }
+
+    std::size_t FilesChunk::getMemoryFootprint() const noexcept
+    {
+        std::size_t size = _tocScratch.capacity() + _files.capacity() * sizeof(FileInfo) + _CRCs.capacity() * sizeof(CRCInfo) + _crcDatabase.capacity() * sizeof(std::uint32_t);
+        for (const FileInfo &file : _files) {
+            size += file._pathName.capacity();
+        }
+        return size;
+    }
+
+    void FilesChunk::decompressFiles(utils::ThreadPool &pool, const utils::PathFilter &filter)
+    {
+        DirectoryOutput output;
+        utils::MemoryBudget unlimited;
+        scheduleFiles(pool, output, unlimited, nullptr, filter);
+        pool.wait();
+        output.wait();
+    }
+
+    // Queues every entry on the pool and returns right away; onComplete runs once the last entry has been written.
+    // Files are read in ascending data offset: neighbouring entries share a read, a task per extent of the read plan,
+    // and each extent asks for the next one to be read ahead before decoding its own entries. Without a filter the kernel
+    // is also told that the whole data region will be read sequentially.
+    // With a manifest, files it has for the same table record are left alone and the others are recorded once written.
+    // With a dedup index, files whose stored bytes were already written during the run become links to that copy.
+    void FilesChunk::scheduleFiles(utils::ThreadPool &pool, Output &output, utils::MemoryBudget &budget, std::function<void()> onComplete, const utils::PathFilter &filter, utils::Stats *stats, ExtractionManifest *manifest, DedupIndex *dedup)
+    {
+        auto job = std::make_shared<ExtractionJob>();
+        job->_reports.resize(_files.size());
+        job->_onComplete = std::move(onComplete);
+        job->_stats = stats;
+        job->_manifest = manifest;
+        job->_dedup = dedup;
+        if (manifest) {
+            job->_archive = manifest->addArchive(_source.getPath());
+        }
+
+        // Directories first, in table order, so that files find their parents already there
+        std::vector<std::size_t> withoutData;
+        std::size_t dataBegin = _fileBufferSize;
+        std::size_t dataEnd = 0ull;
+        job->_plan.reserve(_FileCount);
+        for (std::size_t fileIndex = 0ull; fileIndex < _files.size(); ++fileIndex) {
+            const FileInfo &file = _files[fileIndex];
+            if (!filter.matches(file._pathName)) {
+                continue;
+            }
+            if (file._isDir) {
+                _reportOutput(file, output.createDirectory(file._pathName), 0ull, job->_reports[fileIndex]);
+            } else if (manifest && !manifest->claim(file._pathName, job->_archive)) {
+                job->_reports[fileIndex].add(spdlog::level::warn, "Already extracted from another archive: {}", file._pathName);
+            } else if (manifest && manifest->isUpToDate(file._pathName, _manifestRecord(file, job->_archive))) {
+                job->_reports[fileIndex].add(spdlog::level::debug, "Up to date: {}", file._pathName);
+            } else if (!file._hasData) {
+                withoutData.push_back(fileIndex);
+            } else {
+                job->_plan.add(file._CRC._dataAddr, _entryDataSize(file), fileIndex, file._CRC._fileSize > STREAM_THRESHOLD);
+                dataBegin = std::min<std::size_t>(dataBegin, file._CRC._dataAddr);
+                dataEnd = std::max<std::size_t>(dataEnd, file._CRC._dataAddr + _entryDataSize(file));
+            }
+        }
+        job->_plan.build();
+        if (filter.empty() && dataBegin < dataEnd) {
+            _source.advise(dataBegin, dataEnd - dataBegin, ArchiveSource::Access::Sequential);
+        }
+        job->_remaining = withoutData.size() + job->_plan.getRangeCount();
+        if (job->_remaining == 0) {
+            _finishJob(*job);
+            return;
+        }
+
+        for (std::size_t fileIndex : withoutData) {
+            pool.submit([this, fileIndex, job, &budget, &output](std::size_t) {
+                _extractEntry(job, fileIndex, {}, output, budget);
+            });
+        }
+        for (std::size_t extentIndex = 0ull; extentIndex < job->_plan.getExtents().size(); ++extentIndex) {
+            pool.submit([this, extentIndex, job, &budget, &output](std::size_t) {
+                _extractExtent(job, extentIndex, output, budget);
+            });
+        }
+    }
+
+    // One read for the whole extent, then its entries in offset order. Large entries have an extent of their own
+    // and read their data window by window while decoding it.
+    void FilesChunk::_extractExtent(const std::shared_ptr<ExtractionJob> &job, std::size_t extentIndex, Output &output, utils::MemoryBudget &budget) const
+    {
+        const std::vector<ReadPlan::Extent> &extents = job->_plan.getExtents();
+        const ReadPlan::Extent &extent = extents[extentIndex];
+        const std::span<const ReadPlan::Range> ranges = job->_plan.getRanges(extent);
+        if (extentIndex + 1 < extents.size()) {
+            _source.advise(extents[extentIndex + 1]._offset, extents[extentIndex + 1]._size, ArchiveSource::Access::WillNeed);
+        }
+
+        // An extent of a single entry is read into the buffer that can be handed over to the output with it
+        const bool streamed = ranges.size() == 1 && ranges.front()._alone;
+        WorkerContext &context = _workerContext();
+        std::span<const std::byte> data;
+        job->_reads.record(extent._offset, extent._size);
+        if (!streamed) {
+            try {
+                data = _source.read(extent._offset, extent._size, ranges.size() == 1 ? context._extent : context._scratch);
+            } catch (const std::exception &e) {
+                for (const ReadPlan::Range &range : ranges) {
+                    job->_reports[range._id].add(spdlog::level::err, "Could not extract {}: {}", _files[range._id]._pathName, e.what());
+                    _completeEntry(*job);
                 }
+                return;
             }
-            // _createFile(file);
+        }
+        for (const ReadPlan::Range &range : ranges) {
+            _extractEntry(job, range._id, streamed ? std::span<const std::byte>() : data.subspan(range._offset - extent._offset, range._size), output, budget);
         }
     }
 
-    void FilesChunk::decompressFiles()
+    void FilesChunk::_extractEntry(const std::shared_ptr<ExtractionJob> &job, std::size_t fileIndex, std::span<const std::byte> stored, Output &output, utils::MemoryBudget &budget) const
     {
-        std::unordered_map<std::string, std::function<std::unique_ptr<ntt::BaseHandler>(const std::vector<std::byte> &)>> handlerFactories = {
-            {"ZIPX", [](const std::vector<std::byte> &buffer) { return std::make_unique<zipx::ZipX>(buffer); }},
-            {"LZ2K", [](const std::vector<std::byte> &buffer) { return std::make_unique<lz2k::LZ2K>(buffer); }},
+        const FileInfo &file = _files[fileIndex];
+        const std::size_t memorySize = _entryMemorySize(file);
+        EntryReport &report = job->_reports[fileIndex];
+
+        std::optional<DedupIndex::Key> firstCopy;
+        if (job->_dedup && _linkDuplicate(file, stored, output, *job->_dedup, report, firstCopy)) {
+            _completeEntry(*job);
+            return;
+        }
+
+        // The entry memory is held until its data has been written out, and a first copy can be linked to from then on
+        auto onWritten = [this, job, &budget, &report, memorySize, firstCopy]() {
+            if (firstCopy) {
+                job->_dedup->complete(*firstCopy, report._written && !report._failed);
+            }
+            budget.releaseEntry(memorySize);
+            _completeEntry(*job);
         };
-        std::string fileSign;
 
-        for (FileInfo &file : _files)
-        {
-            if (!file._isDir && file._CRC._fileSize != file._CRC._fileZsize) {
-                if (file._dataBuffer.size() >= 4ull) {
-                    fileSign = std::string(reinterpret_cast<const char*>(&file._dataBuffer[0]), 4);
-                    auto it = handlerFactories.find(fileSign);
-                    if (it != handlerFactories.end()) {
-                        auto handler = it->second(file._dataBuffer);
-                        handler->handle();
-                    } else {
-                        spdlog::warn("{} with signature {} is unknown.", file._fileName, fileSign);
-                    }
-                } else {
-                    spdlog::warn("File {} has insufficient data for signature extraction", file._fileName);
-                }
+        budget.acquireEntry(memorySize);
+        try {
+            _extractFile(file, stored, output, report, onWritten);
+        } catch (const std::exception &e) {
+            report.add(spdlog::level::err, "Could not extract {}: {}", file._pathName, e.what());
+            onWritten();
+        }
+    }
+
+    // Writes the file as a link when an earlier file of the run has the same stored bytes, false when it is to be extracted.
+    // Otherwise firstCopy is set when the file is the first with its bytes, to be completed once written.
+    // A link the output cannot create stops deduplication, the file is then extracted like the rest.
+    bool FilesChunk::_linkDuplicate(const FileInfo &file, std::span<const std::byte> stored, Output &output, DedupIndex &dedup, EntryReport &report, std::optional<DedupIndex::Key> &firstCopy) const
+    {
+        if (!file._hasData || file._CRC._fileSize < DedupIndex::MIN_SIZE || !dedup.isEnabled()) {
+            return false;
+        }
+
+        DedupIndex::Key key;
+        try {
+            // Large entries are hashed from the archive, as they read their data themselves
+            key = stored.empty() ? DedupIndex::makeKey(_source, file._CRC._dataAddr, _entryDataSize(file), file._CRC._fileSize, _workerContext()._scratch)
+                                 : DedupIndex::makeKey(stored, file._CRC._fileSize);
+        } catch (const std::exception &) {
+            return false; // Reported by the extraction
+        }
+        bool first = false;
+        const std::string existingPath = dedup.find(key, {_source.getPath(), file._CRC._dataAddr}, _source, file._pathName, first);
+        if (first) {
+            firstCopy = key;
+        }
+        if (existingPath.empty()) {
+            return false;
+        }
+
+        const Output::Result result = output.link(file._pathName, existingPath, dedup.getMode() == DedupIndex::Mode::Reflink);
+        if (result._status == Output::Status::Failed) {
+            dedup.disable(result._error);
+            return false;
+        }
+        if (result._status == Output::Status::Written) {
+            dedup.addLinked(file._CRC._fileSize);
+            report.add(spdlog::level::debug, "Linked {} to {}", file._pathName, existingPath);
+        }
+        _reportOutput(file, result, file._CRC._fileSize, report);
+        return true;
+    }
+
+    void FilesChunk::_completeEntry(ExtractionJob &job) const
+    {
+        if (job._remaining.fetch_sub(1) == 1) {
+            _finishJob(job);
+        }
+    }
+
+    void FilesChunk::_finishJob(ExtractionJob &job) const
+    {
+        utils::Stats::Counters decode;
+        for (std::size_t fileIndex = 0ull; fileIndex < job._reports.size(); ++fileIndex) {
+            const EntryReport &report = job._reports[fileIndex];
+            for (const auto &[level, line] : report._lines) {
+                spdlog::log(level, line);
+            }
+            job._failures += report._failed ? 1 : 0;
+            // Files that did not come out right are forgotten, so that the next run extracts them again
+            if (job._manifest && report._failed) {
+                job._manifest->erase(_files[fileIndex]._pathName);
+            } else if (job._manifest && report._written) {
+                job._manifest->update(_files[fileIndex]._pathName, _manifestRecord(_files[fileIndex], job._archive));
             }
-            _createFile(file);
+            if (job._stats && !report._codec.empty()) {
+                job._stats->addCodec(report._codec, report._decode);
+                decode += report._decode;
+            }
+        }
+        if (job._stats) {
+            job._stats->addStage("decompress", decode);
+            job._stats->addReads(job._reads.getReads(), job._reads.getSequentialReads(), job._reads.getBytes());
+        }
+        if (job._reads.getReads() != 0) {
+            spdlog::info("Read {:.1f} MB in {} reads, {:.0f}% sequential, {:.0f} KB on average", job._reads.getBytes() / 1048576.0, job._reads.getReads(),
+                100.0 * job._reads.getSequentialReads() / job._reads.getReads(), job._reads.getBytes() / 1024.0 / job._reads.getReads());
+        }
+        job._reports.clear();
+        if (job._onComplete) {
+            job._onComplete();
         }
     }
 
@@ -0,0 +1,209 @@
+#ifndef ARCHIVE_SOURCE_HPP
+#define ARCHIVE_SOURCE_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include "spdlog/spdlog.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+    #define NTT_POSIX_IO 1
+#else
+    #include <filesystem>
+    #include <fstream>
+    #include <mutex>
+#endif
+
+namespace ntt
+{
+    // Read-only view over an archive on disk.
+    // The whole file is memory-mapped when possible so callers get zero-copy spans;
+    // otherwise each read falls back to a positioned read into a caller-owned scratch buffer.
+    class ArchiveSource
+    {
+        public:
+            enum class Access {
+                Normal,
+                Sequential,
+                Random,
+                WillNeed,
+                DontNeed
+            };
+
+            explicit ArchiveSource(const std::string &path, bool useMapping = true);
+            ~ArchiveSource();
+
+            ArchiveSource(const ArchiveSource &) = delete;
+            ArchiveSource &operator=(const ArchiveSource &) = delete;
+
+            const std::string &getPath() const noexcept { return _path; }
+            std::size_t getSize() const noexcept { return _size; }
+            std::int64_t getModificationTime() const noexcept { return _modificationTime; } // Nanoseconds since the epoch
+            bool isMapped() const noexcept { return _mapping != nullptr; }
+
+            std::span<const std::byte> read(std::size_t offset, std::size_t size, std::vector<std::byte> &scratch) const;
+            void advise(std::size_t offset, std::size_t size, Access access) const;
+
+        private:
+            std::string _path;
+            std::size_t _size{0};
+            std::int64_t _modificationTime{0};
+            const std::byte *_mapping{nullptr};
+#ifdef NTT_POSIX_IO
+            int _fd{-1};
+#else
+            mutable std::ifstream _stream;
+            mutable std::mutex _streamMutex;
+#endif
+    };
+
+#ifdef NTT_POSIX_IO
+    ArchiveSource::ArchiveSource(const std::string &path, bool useMapping)
+        : _path(path)
+    {
+        _fd = ::open(_path.c_str(), O_RDONLY);
+        if (_fd < 0) {
+            throw std::ios_base::failure("Failed to open file: " + _path);
+        }
+
+        struct stat fileStat{};
+        if (::fstat(_fd, &fileStat) != 0) {
+            ::close(_fd);
+            throw std::ios_base::failure("Failed to stat file: " + _path);
+        }
+        _size = static_cast<std::size_t>(fileStat.st_size);
+#if defined(__APPLE__)
+        _modificationTime = static_cast<std::int64_t>(fileStat.st_mtimespec.tv_sec) * 1000000000 + fileStat.st_mtimespec.tv_nsec;
+#else
+        _modificationTime = static_cast<std::int64_t>(fileStat.st_mtim.tv_sec) * 1000000000 + fileStat.st_mtim.tv_nsec;
+#endif
+
+        if (useMapping && _size != 0) {
+            void *mapping = ::mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, _fd, 0);
+            if (mapping != MAP_FAILED) {
+                _mapping = static_cast<const std::byte *>(mapping);
+            } else {
+                spdlog::warn("Could not map {}, falling back to positioned reads: {}", _path, std::strerror(errno));
+            }
+        }
+    }
+
+    ArchiveSource::~ArchiveSource()
+    {
+        if (_mapping != nullptr) {
+            ::munmap(const_cast<std::byte *>(_mapping), _size);
+        }
+        if (_fd >= 0) {
+            ::close(_fd);
+        }
+    }
+
+    std::span<const std::byte> ArchiveSource::read(std::size_t offset, std::size_t size, std::vector<std::byte> &scratch) const
+    {
+        if (offset > _size || size > _size - offset) {
+            throw std::out_of_range("Read of " + std::to_string(size) + " bytes at offset " + std::to_string(offset) + " is beyond the end of " + _path);
+        }
+
+        if (_mapping != nullptr) {
+            return {_mapping + offset, size};
+        }
+
+        scratch.resize(size);
+        std::size_t done = 0ull;
+        while (done < size) {
+            ssize_t count = ::pread(_fd, scratch.data() + done, size - done, static_cast<off_t>(offset + done));
+            if (count < 0 && errno == EINTR) {
+                continue;
+            }
+            if (count <= 0) {
+                throw std::ios_base::failure("Error while reading file: " + _path);
+            }
+            done += static_cast<std::size_t>(count);
+        }
+        return {scratch.data(), size};
+    }
+
+    void ArchiveSource::advise(std::size_t offset, std::size_t size, Access access) const
+    {
+        if (offset >= _size || size == 0) {
+            return;
+        }
+        size = std::min(size, _size - offset);
+
+        if (_mapping != nullptr) {
+            // madvise needs a page aligned start
+            const std::size_t pageSize = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+            const std::size_t alignedOffset = offset - (offset % pageSize);
+            int advice = MADV_NORMAL;
+            switch (access) {
+                case Access::Sequential: advice = MADV_SEQUENTIAL; break;
+                case Access::Random: advice = MADV_RANDOM; break;
+                case Access::WillNeed: advice = MADV_WILLNEED; break;
+                case Access::DontNeed: advice = MADV_DONTNEED; break;
+                default: break;
+            }
+            ::madvise(const_cast<std::byte *>(_mapping) + alignedOffset, size + (offset - alignedOffset), advice);
+        } else {
+#ifdef POSIX_FADV_NORMAL
+            int advice = POSIX_FADV_NORMAL;
+            switch (access) {
+                case Access::Sequential: advice = POSIX_FADV_SEQUENTIAL; break;
+                case Access::Random: advice = POSIX_FADV_RANDOM; break;
+                case Access::WillNeed: advice = POSIX_FADV_WILLNEED; break;
+                case Access::DontNeed: advice = POSIX_FADV_DONTNEED; break;
+                default: break;
+            }
+            ::posix_fadvise(_fd, static_cast<off_t>(offset), static_cast<off_t>(size), advice);
+#endif
+        }
+    }
+#else
+    ArchiveSource::ArchiveSource(const std::string &path, bool)
+        : _path(path), _stream(path, std::ios::binary | std::ios::ate)
+    {
+        if (!_stream) {
+            throw std::ios_base::failure("Failed to open file: " + _path);
+        }
+        _size = static_cast<std::size_t>(_stream.tellg());
+        _modificationTime = std::chrono::duration_cast<std::chrono::nanoseconds>(std::filesystem::last_write_time(path).time_since_epoch()).count();
+    }
+
+    ArchiveSource::~ArchiveSource()
+    {
+    }
+
+    std::span<const std::byte> ArchiveSource::read(std::size_t offset, std::size_t size, std::vector<std::byte> &scratch) const
+    {
+        if (offset > _size || size > _size - offset) {
+            throw std::out_of_range("Read of " + std::to_string(size) + " bytes at offset " + std::to_string(offset) + " is beyond the end of " + _path);
+        }
+
+        std::lock_guard<std::mutex> lock(_streamMutex);
+        scratch.resize(size);
+        _stream.seekg(static_cast<std::streamoff>(offset), std::ios::beg);
+        _stream.read(reinterpret_cast<char *>(scratch.data()), static_cast<std::streamsize>(size));
+        if (!_stream) {
+            throw std::ios_base::failure("Error while reading file: " + _path);
+        }
+        return {scratch.data(), size};
+    }
+
+    void ArchiveSource::advise(std::size_t, std::size_t, Access) const
+    {
+    }
+#endif
+
+} // namespace ntt
+
+#endif // ARCHIVE_SOURCE_HPP
@@ -0,0 +1,195 @@
+#ifndef DEDUP_INDEX_HPP
+#define DEDUP_INDEX_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <zlib.h>
+#include "spdlog/spdlog.h"
+#include "IO/ArchiveSource.hpp"
+
+namespace ntt
+{
+    // Files of a run whose stored bytes are identical, so that repeats are linked to the first copy written
+    // instead of being decoded and written again, within an archive and across archives.
+    // Candidates share their stored size, decoded size and the CRC-32 of their stored bytes; a repeat is only linked
+    // once its stored bytes compared equal to those of a first copy that decoded and was written without error.
+    // Same input, same decoder: the decoded output is the one already on disk.
+    // Thread safe.
+    class DedupIndex
+    {
+        public:
+            enum class Mode {
+                HardLink,
+                Reflink
+            };
+            struct Key {
+                std::uint32_t _fileZsize;
+                std::uint32_t _fileSize;
+                std::uint32_t _crc; // Of the stored bytes
+
+                bool operator==(const Key &other) const = default;
+            };
+            // Where the stored bytes of a file are
+            struct Location {
+                std::string _archivePath;
+                std::size_t _dataAddr;
+            };
+
+            static constexpr std::size_t MIN_SIZE = 4096ull; // Smaller files are always written
+            static constexpr std::size_t WINDOW = 8ull << 20; // Bytes read at once when hashing or comparing from an archive
+
+            explicit DedupIndex(Mode mode) : _mode(mode) {}
+
+            Mode getMode() const noexcept { return _mode; }
+            bool isEnabled() const noexcept { return !_disabled; }
+
+            static Key makeKey(std::span<const std::byte> stored, std::uint32_t fileSize);
+            // The same, reading the stored bytes window by window
+            static Key makeKey(const ArchiveSource &source, std::size_t dataAddr, std::uint32_t fileZsize, std::uint32_t fileSize, std::vector<std::byte> &scratch);
+
+            // Output path of an earlier file with these very stored bytes, empty when there is none yet.
+            // The first file of a key becomes its pending first copy and first is set, it must be completed.
+            std::string find(const Key &key, const Location &location, const ArchiveSource &source, const std::string &path, bool &first);
+            // Ends the pending first copy of key: later files link to it when it was written, else the key is forgotten
+            void complete(const Key &key, bool written);
+            // Counts a repeat written as a link
+            void addLinked(std::size_t bytes) noexcept { _linkedFiles += 1; _linkedBytes += bytes; }
+            // Stops linking for the rest of the run, after the output could not create a link
+            void disable(const std::string &reason);
+
+            std::size_t getLinkedFiles() const noexcept { return _linkedFiles; }
+            std::size_t getLinkedBytes() const noexcept { return _linkedBytes; }
+
+        private:
+            struct KeyHash {
+                std::size_t operator()(const Key &key) const noexcept {
+                    return (static_cast<std::size_t>(key._crc) << 32) ^ (static_cast<std::size_t>(key._fileZsize) * 0x9E3779B1u) ^ key._fileSize;
+                }
+            };
+            struct FirstCopy {
+                Location _location;
+                std::string _path; // In the output
+                bool _written; // False while the first copy is in flight
+            };
+
+            const Mode _mode;
+            std::atomic<bool> _disabled{false};
+            std::mutex _mutex;
+            std::unordered_map<Key, FirstCopy, KeyHash> _copies;
+            std::mutex _sourceMutex;
+            std::unordered_map<std::string, std::unique_ptr<ArchiveSource>> _sources; // Archives of first copies, opened to compare
+            std::atomic<std::size_t> _linkedFiles{0};
+            std::atomic<std::size_t> _linkedBytes{0};
+
+            const ArchiveSource &_sourceOf(const std::string &archivePath);
+            bool _sameBytes(const FirstCopy &copy, const Location &location, const ArchiveSource &source, std::size_t size);
+    };
+
+    DedupIndex::Key DedupIndex::makeKey(std::span<const std::byte> stored, std::uint32_t fileSize)
+    {
+        const uLong crc = ::crc32_z(::crc32(0L, Z_NULL, 0), reinterpret_cast<const Bytef *>(stored.data()), stored.size());
+        return {static_cast<std::uint32_t>(stored.size()), fileSize, static_cast<std::uint32_t>(crc)};
+    }
+
+    DedupIndex::Key DedupIndex::makeKey(const ArchiveSource &source, std::size_t dataAddr, std::uint32_t fileZsize, std::uint32_t fileSize, std::vector<std::byte> &scratch)
+    {
+        uLong crc = ::crc32(0L, Z_NULL, 0);
+        for (std::size_t offset = 0ull; offset < fileZsize; offset += WINDOW) {
+            const std::span<const std::byte> window = source.read(dataAddr + offset, std::min<std::size_t>(WINDOW, fileZsize - offset), scratch);
+            crc = ::crc32_z(crc, reinterpret_cast<const Bytef *>(window.data()), window.size());
+        }
+        return {fileZsize, fileSize, static_cast<std::uint32_t>(crc)};
+    }
+
+    std::string DedupIndex::find(const Key &key, const Location &location, const ArchiveSource &source, const std::string &path, bool &first)
+    {
+        first = false;
+        if (_disabled) {
+            return {};
+        }
+
+        FirstCopy copy;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            auto [it, inserted] = _copies.try_emplace(key, FirstCopy{location, path, false});
+            if (inserted) {
+                first = true;
+                return {};
+            }
+            // A first copy still in flight is not waited for, the file is written in full
+            if (!it->second._written) {
+                return {};
+            }
+            copy = it->second;
+        }
+        return _sameBytes(copy, location, source, key._fileZsize) ? copy._path : std::string();
+    }
+
+    void DedupIndex::complete(const Key &key, bool written)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto it = _copies.find(key);
+        if (it == _copies.end()) {
+            return;
+        }
+        if (written) {
+            it->second._written = true;
+        } else {
+            _copies.erase(it);
+        }
+    }
+
+    void DedupIndex::disable(const std::string &reason)
+    {
+        if (!_disabled.exchange(true)) {
+            spdlog::warn("Duplicates are written in full from now on: {}", reason);
+        }
+    }
+
+    const ArchiveSource &DedupIndex::_sourceOf(const std::string &archivePath)
+    {
+        std::lock_guard<std::mutex> lock(_sourceMutex);
+        std::unique_ptr<ArchiveSource> &source = _sources[archivePath];
+        if (!source) {
+            source = std::make_unique<ArchiveSource>(archivePath);
+        }
+        return *source;
+    }
+
+    // The archive of the first copy may have been closed since, it is opened again on its own.
+    // Any read error counts as a difference.
+    bool DedupIndex::_sameBytes(const FirstCopy &copy, const Location &location, const ArchiveSource &source, std::size_t size)
+    {
+        if (copy._location._archivePath == location._archivePath && copy._location._dataAddr == location._dataAddr) {
+            return true;
+        }
+        std::vector<std::byte> copyScratch;
+        std::vector<std::byte> scratch;
+        try {
+            const ArchiveSource &copySource = _sourceOf(copy._location._archivePath);
+            for (std::size_t offset = 0ull; offset < size; offset += WINDOW) {
+                const std::size_t window = std::min(WINDOW, size - offset);
+                std::span<const std::byte> copyData = copySource.read(copy._location._dataAddr + offset, window, copyScratch);
+                std::span<const std::byte> data = source.read(location._dataAddr + offset, window, scratch);
+                if (std::memcmp(copyData.data(), data.data(), window) != 0) {
+                    return false;
+                }
+            }
+        } catch (const std::exception &) {
+            return false;
+        }
+        return true;
+    }
+} // namespace ntt
+
+#endif // DEDUP_INDEX_HPP
@@ -0,0 +1,498 @@
+#ifndef DIRECTORY_OUTPUT_HPP
+#define DIRECTORY_OUTPUT_HPP
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+#include "Utils/ThreadPool.hpp"
+#include "IO/Output.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+    #include <fcntl.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+    #ifdef __linux__
+        #include <sys/ioctl.h>
+        // From linux/fs.h, which is not included for the macros it leaks (BLOCK_SIZE)
+        #ifndef FICLONE
+            #define FICLONE _IOW(0x94, 9, int)
+        #endif
+    #endif
+    #ifndef NTT_POSIX_IO
+        #define NTT_POSIX_IO 1
+    #endif
+#else
+    #include <fstream>
+#endif
+
+namespace ntt
+{
+    // Writes entries as files under a root directory.
+    // Created directories are remembered so each one costs a single mkdir, files are opened exclusively
+    // (which doubles as the "already exists" check) unless existing files are replaced, preallocated, and written by a small pool of writer
+    // threads so that decoding never waits on the filesystem, the files of a directory by the same writer. At most maxPending writes are queued,
+    // further writes block the caller until the writers catch up. Streams write from the caller's thread.
+    class DirectoryOutput : public Output
+    {
+        public:
+            static constexpr std::size_t DEFAULT_WRITERS = 4ull;
+
+            explicit DirectoryOutput(const std::string &root = "./Content", std::size_t writerCount = DEFAULT_WRITERS, std::size_t maxPending = 64ull);
+            ~DirectoryOutput() override;
+
+            Result createDirectory(const std::string &path) override;
+            void write(const std::string &path, std::span<const std::byte> data, std::vector<std::byte> owned, Completion onDone) override;
+            Result openStream(const std::string &path, std::size_t size, std::unique_ptr<Stream> &stream) override;
+            // Made right away, from the caller's thread
+            Result link(const std::string &path, const std::string &existingPath, bool clone) override;
+            void wait() override;
+            // Existing files are truncated and rewritten instead of reported as AlreadyExists. Set before the first write.
+            void setReplaceExisting(bool replace) noexcept { _replaceExisting = replace; }
+
+            std::vector<std::byte> takeBuffer() override;
+            Stats getStats() const override;
+
+        private:
+            static constexpr std::size_t KEEP_BUFFER_SIZE = 64ull << 20; // Larger buffers are not recycled
+
+            // Platform file handle, counting the system calls it makes
+            class File
+            {
+                public:
+                    explicit File(std::atomic<std::size_t> &syscallCount) : _syscallCount(syscallCount) {}
+                    ~File() { close(); }
+
+                    Status open(const std::string &path, std::size_t size, bool replace);
+                    bool write(std::span<const std::byte> data);
+                    bool truncate();
+                    bool close();
+#if defined(NTT_POSIX_IO) && defined(FICLONE)
+                    // Shares the storage of sourcePath, returns 0 or the errno of the failed call
+                    int clone(const std::string &sourcePath);
+#endif
+
+                private:
+                    std::atomic<std::size_t> &_syscallCount;
+#ifdef NTT_POSIX_IO
+                    int _fd{-1};
+#else
+                    std::string _path;
+                    std::ofstream _stream;
+#endif
+            };
+
+            class FileStream : public Stream
+            {
+                public:
+                    FileStream(DirectoryOutput &output, const std::string &fullPath) : _output(output), _file(output._syscallCount), _fullPath(fullPath) {}
+
+                    Status open(std::size_t size) { return _file.open(_fullPath, size, _output._replaceExisting); }
+                    void write(std::span<const std::byte> data) override;
+                    void rewind() override;
+                    Result close() override;
+
+                private:
+                    DirectoryOutput &_output;
+                    File _file;
+                    std::string _fullPath;
+                    std::size_t _written{0};
+                    bool _failed{false};
+            };
+
+            const std::string _root;
+            const std::size_t _maxPending;
+            const std::chrono::steady_clock::time_point _start;
+            bool _replaceExisting{false};
+            std::mutex _directoryMutex;
+            std::unordered_set<std::string> _directories; // Known to exist, relative to the root
+            std::mutex _pendingMutex;
+            std::condition_variable _pendingCondition;
+            std::size_t _pending{0};
+            std::mutex _bufferMutex;
+            std::vector<std::vector<std::byte>> _buffers;
+            std::atomic<std::size_t> _fileCount{0};
+            std::atomic<std::size_t> _directoryCount{0};
+            std::atomic<std::size_t> _byteCount{0};
+            std::atomic<std::size_t> _syscallCount{0};
+            utils::ThreadPool _writers; // Last, so that it is joined before the state above goes away
+
+            int _makeDirectory(const std::string &relativePath, bool &existed);
+            Result _makeParent(const std::string &path);
+            Result _writeFile(const std::string &path, std::span<const std::byte> data);
+    };
+
+    DirectoryOutput::DirectoryOutput(const std::string &root, std::size_t writerCount, std::size_t maxPending)
+        : _root(root), _maxPending(std::max<std::size_t>(maxPending, 1ull)), _start(std::chrono::steady_clock::now()), _writers(writerCount)
+    {
+        std::error_code errCode;
+        std::filesystem::create_directories(_root, errCode);
+        _directories.insert("");
+    }
+
+    DirectoryOutput::~DirectoryOutput()
+    {
+        wait();
+    }
+
+    // Creates every missing component of relativePath, one mkdir per component never seen before.
+    // Returns 0 or the errno of the failed mkdir.
+    int DirectoryOutput::_makeDirectory(const std::string &relativePath, bool &existed)
+    {
+        existed = true;
+        std::size_t end = 0ull;
+        while (end != std::string::npos) {
+            end = relativePath.find('/', end + 1);
+            const std::string component = relativePath.substr(0, end);
+            if (_directories.contains(component)) {
+                continue;
+            }
+
+            const std::string fullPath = _root + "/" + component;
+            _syscallCount += 1;
+#ifdef NTT_POSIX_IO
+            const bool created = ::mkdir(fullPath.c_str(), 0755) == 0;
+            if (!created && errno != EEXIST) {
+                return errno;
+            }
+#else
+            std::error_code errCode;
+            const bool created = std::filesystem::create_directory(fullPath, errCode);
+            if (errCode) {
+                return errCode.value();
+            }
+#endif
+            existed = !created;
+            _directoryCount += created ? 1 : 0;
+            _directories.insert(component);
+        }
+        return 0;
+    }
+
+    Output::Result DirectoryOutput::createDirectory(const std::string &path)
+    {
+        std::lock_guard<std::mutex> lock(_directoryMutex);
+        const std::string fullPath = _root + "/" + path;
+        bool existed = false;
+
+        if (const int error = _makeDirectory(path, existed); error != 0) {
+            return {Status::Failed, fullPath, "Could not create directories for " + path + ": " + std::strerror(error)};
+        }
+        return {existed ? Status::AlreadyExists : Status::Written, fullPath, {}};
+    }
+
+#ifdef NTT_POSIX_IO
+    Output::Status DirectoryOutput::File::open(const std::string &path, std::size_t size, bool replace)
+    {
+        _syscallCount += 1;
+        _fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC | (replace ? O_TRUNC : O_EXCL), 0644);
+        if (_fd < 0) {
+            return errno == EEXIST ? Status::AlreadyExists : Status::Failed;
+        }
+    #ifdef __linux__
+        // Lets the filesystem lay the file out in one go; unsupported filesystems just skip it
+        if (size != 0) {
+            _syscallCount += 1;
+            ::fallocate(_fd, 0, 0, static_cast<off_t>(size));
+        }
+    #endif
+        return Status::Written;
+    }
+
+    bool DirectoryOutput::File::write(std::span<const std::byte> data)
+    {
+        std::size_t done = 0ull;
+        while (done < data.size()) {
+            _syscallCount += 1;
+            const ssize_t count = ::write(_fd, data.data() + done, data.size() - done);
+            if (count < 0 && errno == EINTR) {
+                continue;
+            }
+            if (count <= 0) {
+                return false;
+            }
+            done += static_cast<std::size_t>(count);
+        }
+        return true;
+    }
+
+    bool DirectoryOutput::File::truncate()
+    {
+        _syscallCount += 2;
+        return ::ftruncate(_fd, 0) == 0 && ::lseek(_fd, 0, SEEK_SET) == 0;
+    }
+
+    bool DirectoryOutput::File::close()
+    {
+        if (_fd < 0) {
+            return true;
+        }
+        _syscallCount += 1;
+        const bool closed = ::close(_fd) == 0;
+        _fd = -1;
+        return closed;
+    }
+
+    #ifdef FICLONE
+    int DirectoryOutput::File::clone(const std::string &sourcePath)
+    {
+        _syscallCount += 3;
+        const int source = ::open(sourcePath.c_str(), O_RDONLY | O_CLOEXEC);
+        if (source < 0) {
+            return errno;
+        }
+        const int error = ::ioctl(_fd, FICLONE, source) == 0 ? 0 : errno;
+        ::close(source);
+        return error;
+    }
+    #endif
+#else
+    Output::Status DirectoryOutput::File::open(const std::string &path, std::size_t, bool replace)
+    {
+        _syscallCount += 2;
+        if (!replace && std::filesystem::exists(path)) {
+            return Status::AlreadyExists;
+        }
+        _path = path;
+        _stream.open(path, std::ios::out | std::ios::binary | std::ios::trunc);
+        return _stream ? Status::Written : Status::Failed;
+    }
+
+    bool DirectoryOutput::File::write(std::span<const std::byte> data)
+    {
+        _syscallCount += 1;
+        _stream.write(reinterpret_cast<const char *>(data.data()), static_cast<std::streamsize>(data.size()));
+        return static_cast<bool>(_stream);
+    }
+
+    bool DirectoryOutput::File::truncate()
+    {
+        _syscallCount += 2;
+        _stream.close();
+        _stream.open(_path, std::ios::out | std::ios::binary | std::ios::trunc);
+        return static_cast<bool>(_stream);
+    }
+
+    bool DirectoryOutput::File::close()
+    {
+        if (!_stream.is_open()) {
+            return true;
+        }
+        _syscallCount += 1;
+        _stream.close();
+        return !_stream.fail();
+    }
+#endif
+
+    void DirectoryOutput::FileStream::write(std::span<const std::byte> data)
+    {
+        if (!_failed) {
+            _failed = !_file.write(data);
+            _written += data.size();
+        }
+    }
+
+    void DirectoryOutput::FileStream::rewind()
+    {
+        _failed = !_file.truncate();
+        _written = 0ull;
+    }
+
+    Output::Result DirectoryOutput::FileStream::close()
+    {
+        const bool closed = _file.close();
+        if (_failed || !closed) {
+            return {Status::Failed, _fullPath, "Failed to write data to file: " + _fullPath};
+        }
+        _output._fileCount += 1;
+        _output._byteCount += _written;
+        return {Status::Written, _fullPath, {}};
+    }
+
+    Output::Result DirectoryOutput::_writeFile(const std::string &path, std::span<const std::byte> data)
+    {
+        const std::string fullPath = _root + "/" + path;
+        File file(_syscallCount);
+
+        const Status status = file.open(fullPath, data.size(), _replaceExisting);
+        if (status == Status::AlreadyExists) {
+            return {Status::AlreadyExists, fullPath, {}};
+        } else if (status == Status::Failed) {
+            return {Status::Failed, fullPath, "Failed to create file: " + fullPath};
+        }
+        const bool written = file.write(data);
+        if (!file.close() || !written) {
+            return {Status::Failed, fullPath, "Failed to write data to file: " + fullPath};
+        }
+
+        _fileCount += 1;
+        _byteCount += data.size();
+        return {Status::Written, fullPath, {}};
+    }
+
+    // Parents are usually created up front from the directory entries, this only covers the others
+    Output::Result DirectoryOutput::_makeParent(const std::string &path)
+    {
+        const std::size_t parentEnd = path.rfind('/');
+        if (parentEnd != std::string::npos) {
+            std::lock_guard<std::mutex> lock(_directoryMutex);
+            bool existed = false;
+            if (const int error = _makeDirectory(path.substr(0, parentEnd), existed); error != 0) {
+                return {Status::Failed, _root + "/" + path, "Could not create parent directories for file " + path + ": " + std::strerror(error)};
+            }
+        }
+        return {Status::Written, _root + "/" + path, {}};
+    }
+
+    Output::Result DirectoryOutput::openStream(const std::string &path, std::size_t size, std::unique_ptr<Stream> &stream)
+    {
+        if (Result result = _makeParent(path); result._status != Status::Written) {
+            return result;
+        }
+
+        auto fileStream = std::make_unique<FileStream>(*this, _root + "/" + path);
+        const Status status = fileStream->open(size);
+        if (status == Status::AlreadyExists) {
+            return {Status::AlreadyExists, _root + "/" + path, {}};
+        } else if (status == Status::Failed) {
+            return {Status::Failed, _root + "/" + path, "Failed to create file: " + _root + "/" + path};
+        }
+        stream = std::move(fileStream);
+        return {Status::Written, _root + "/" + path, {}};
+    }
+
+    // A clone is a file of its own that the filesystem backs with the blocks of the existing one (copy on write),
+    // a hard link another name for the existing file. Replacing removes the previous file of a hard link first.
+    Output::Result DirectoryOutput::link(const std::string &path, const std::string &existingPath, bool clone)
+    {
+        if (Result result = _makeParent(path); result._status != Status::Written) {
+            return result;
+        }
+        const std::string fullPath = _root + "/" + path;
+        const std::string existingFullPath = _root + "/" + existingPath;
+
+        if (clone) {
+#if defined(NTT_POSIX_IO) && defined(FICLONE)
+            File file(_syscallCount);
+            const Status status = file.open(fullPath, 0ull, _replaceExisting);
+            if (status == Status::AlreadyExists) {
+                return {Status::AlreadyExists, fullPath, {}};
+            } else if (status == Status::Failed) {
+                return {Status::Failed, fullPath, "Failed to create file: " + fullPath};
+            }
+            if (const int error = file.clone(existingFullPath); error != 0) {
+                file.close();
+                _syscallCount += 1;
+                ::unlink(fullPath.c_str());
+                return {Status::Failed, fullPath, "Could not clone " + existingFullPath + ": " + std::strerror(error)};
+            }
+            if (!file.close()) {
+                return {Status::Failed, fullPath, "Failed to write data to file: " + fullPath};
+            }
+#else
+            return {Status::Failed, fullPath, "Cloning files is not supported on this platform"};
+#endif
+        } else {
+#ifdef NTT_POSIX_IO
+            if (_replaceExisting) {
+                _syscallCount += 1;
+                ::unlink(fullPath.c_str());
+            }
+            _syscallCount += 1;
+            if (::link(existingFullPath.c_str(), fullPath.c_str()) != 0) {
+                if (errno == EEXIST) {
+                    return {Status::AlreadyExists, fullPath, {}};
+                }
+                return {Status::Failed, fullPath, "Could not link " + fullPath + " to " + existingFullPath + ": " + std::strerror(errno)};
+            }
+#else
+            std::error_code errCode;
+            _syscallCount += 2;
+            if (_replaceExisting) {
+                std::filesystem::remove(fullPath, errCode);
+            } else if (std::filesystem::exists(fullPath, errCode)) {
+                return {Status::AlreadyExists, fullPath, {}};
+            }
+            std::filesystem::create_hard_link(existingFullPath, fullPath, errCode);
+            if (errCode) {
+                return {Status::Failed, fullPath, "Could not link " + fullPath + " to " + existingFullPath + ": " + errCode.message()};
+            }
+#endif
+        }
+        _fileCount += 1;
+        return {Status::Written, fullPath, {}};
+    }
+
+    void DirectoryOutput::write(const std::string &path, std::span<const std::byte> data, std::vector<std::byte> owned, Completion onDone)
+    {
+        {
+            std::unique_lock<std::mutex> lock(_pendingMutex);
+            _pendingCondition.wait(lock, [this]() { return _pending < _maxPending; });
+            _pending += 1;
+        }
+
+        if (Result result = _makeParent(path); result._status != Status::Written) {
+            {
+                std::lock_guard<std::mutex> lock(_pendingMutex);
+                _pending -= 1;
+            }
+            _pendingCondition.notify_all();
+            onDone(result);
+            return;
+        }
+
+        // Files of a directory go to the same writer, which creates them one after the other
+        const std::size_t parentEnd = path.rfind('/');
+        const std::size_t directoryKey = std::hash<std::string_view>{}(std::string_view(path).substr(0, parentEnd == std::string::npos ? 0 : parentEnd));
+        _writers.submitTo(directoryKey, [this, path, data, owned = std::move(owned), onDone = std::move(onDone)](std::size_t) mutable {
+            const Result result = _writeFile(path, data);
+            {
+                std::lock_guard<std::mutex> lock(_pendingMutex);
+                _pending -= 1;
+            }
+            _pendingCondition.notify_all();
+
+            if (owned.capacity() != 0 && owned.capacity() <= KEEP_BUFFER_SIZE) {
+                owned.clear();
+                std::lock_guard<std::mutex> lock(_bufferMutex);
+                if (_buffers.size() < _maxPending) {
+                    _buffers.push_back(std::move(owned));
+                }
+            }
+            onDone(result);
+        });
+    }
+
+    void DirectoryOutput::wait()
+    {
+        _writers.wait();
+    }
+
+    std::vector<std::byte> DirectoryOutput::takeBuffer()
+    {
+        std::lock_guard<std::mutex> lock(_bufferMutex);
+        if (_buffers.empty()) {
+            return {};
+        }
+        std::vector<std::byte> buffer = std::move(_buffers.back());
+        _buffers.pop_back();
+        return buffer;
+    }
+
+    Output::Stats DirectoryOutput::getStats() const
+    {
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - _start;
+        return {_fileCount.load(), _directoryCount.load(), _byteCount.load(), _syscallCount.load(), elapsed.count()};
+    }
+} // namespace ntt
+
+#endif // DIRECTORY_OUTPUT_HPP
@@ -0,0 +1,269 @@
+#ifndef EXTRACTION_MANIFEST_HPP
+#define EXTRACTION_MANIFEST_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "spdlog/spdlog.h"
+#include "Utils/PathFilter.hpp"
+
+namespace ntt
+{
+    // What previous runs extracted into an output directory, so that an incremental run only rewrites the files
+    // whose table record changed and removes the files whose entry is gone from their archive.
+    // Within a run, a path belongs to the first archive claiming it, like without replacing existing files.
+    // Kept as text at the root of the output: a line per archive, followed by a line per file it wrote,
+    // "crc zsize size dataAddr path" with the numbers in hexadecimal and tabs in between.
+    // Lookups and updates are thread safe.
+    class ExtractionManifest
+    {
+        public:
+            static constexpr std::string_view FILE_NAME = ".ntt-manifest";
+            static constexpr std::string_view HEADER = "# ntt-manifest 1";
+
+            struct Record {
+                std::uint32_t _archive; // Id returned by addArchive()
+                std::uint32_t _crcValue;
+                std::uint32_t _fileZsize;
+                std::uint32_t _fileSize;
+                std::uint32_t _dataAddr;
+
+                bool operator==(const Record &other) const = default;
+            };
+
+            // Loads the manifest of root, a missing or malformed one is an empty manifest
+            explicit ExtractionManifest(const std::string &root);
+
+            // Id of an archive, which counts as extracted by this run from then on
+            std::uint32_t addArchive(const std::string &archivePath);
+            // Whether path was written from this very record and is still there with its size
+            bool isUpToDate(const std::string &path, const Record &record);
+            // Makes archive the source of path for this run, false when another archive of this run already is
+            bool claim(const std::string &path, std::uint32_t archive);
+            void update(const std::string &path, const Record &record);
+            void erase(const std::string &path);
+
+            // Deletes the files extracted by a previous run from an archive of this run, when no archive of this run
+            // claimed their path. Paths outside of filter are kept. Returns the count.
+            std::size_t removeOrphans(const utils::PathFilter &filter);
+            // Replaces the manifest file atomically, throws std::ios_base::failure when it cannot be written
+            void save() const;
+
+            std::size_t getUpToDateCount() const noexcept { return _upToDateCount; }
+
+        private:
+            static constexpr std::uint32_t NO_ARCHIVE = 0xFFFFFFFF;
+
+            struct Entry {
+                Record _record;
+                bool _recorded; // _record describes the file on disk
+                std::uint32_t _claimedBy; // Archive of this run the path comes from
+            };
+
+            const std::string _root;
+            mutable std::mutex _mutex;
+            std::vector<std::string> _archives; // Canonical paths, by id
+            std::unordered_set<std::uint32_t> _extracted; // Archives of this run
+            std::unordered_map<std::string, Entry> _entries; // By path relative to the root
+            std::atomic<std::size_t> _upToDateCount{0};
+
+            std::string _path() const { return _root + "/" + std::string(FILE_NAME); }
+            void _load(std::ifstream &file);
+    };
+
+    ExtractionManifest::ExtractionManifest(const std::string &root)
+        : _root(root)
+    {
+        std::ifstream file(_path());
+        if (!file) {
+            return;
+        }
+        try {
+            _load(file);
+        } catch (const std::out_of_range &e) {
+            spdlog::warn("Ignoring the manifest {}, every entry will be extracted again: {}", _path(), e.what());
+            _archives.clear();
+            _entries.clear();
+        }
+    }
+
+    void ExtractionManifest::_load(std::ifstream &file)
+    {
+        auto parseHex = [](std::string_view &line, std::uint32_t &value) {
+            const auto [end, error] = std::from_chars(line.data(), line.data() + line.size(), value, 16);
+            if (error != std::errc() || end == line.data() + line.size() || *end != '\t') {
+                throw std::out_of_range("malformed record");
+            }
+            line.remove_prefix(static_cast<std::size_t>(end - line.data()) + 1);
+        };
+
+        std::string line;
+        if (!std::getline(file, line) || line != HEADER) {
+            throw std::out_of_range("unknown format");
+        }
+        while (std::getline(file, line)) {
+            std::string_view rest = line;
+            if (rest.starts_with("archive\t")) {
+                _archives.emplace_back(rest.substr(8));
+                continue;
+            }
+            if (_archives.empty()) {
+                throw std::out_of_range("record before any archive");
+            }
+            Record record{static_cast<std::uint32_t>(_archives.size() - 1), 0u, 0u, 0u, 0u};
+            parseHex(rest, record._crcValue);
+            parseHex(rest, record._fileZsize);
+            parseHex(rest, record._fileSize);
+            parseHex(rest, record._dataAddr);
+            if (rest.empty()) {
+                throw std::out_of_range("record without path");
+            }
+            _entries[std::string(rest)] = {record, true, NO_ARCHIVE};
+        }
+    }
+
+    std::uint32_t ExtractionManifest::addArchive(const std::string &archivePath)
+    {
+        std::error_code error;
+        std::string canonical = std::filesystem::weakly_canonical(archivePath, error).string();
+        if (error) {
+            canonical = std::filesystem::absolute(archivePath, error).string();
+        }
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto it = std::find(_archives.begin(), _archives.end(), canonical);
+        if (it == _archives.end()) {
+            it = _archives.insert(_archives.end(), std::move(canonical));
+        }
+        const std::uint32_t archive = static_cast<std::uint32_t>(it - _archives.begin());
+        _extracted.insert(archive);
+        return archive;
+    }
+
+    bool ExtractionManifest::isUpToDate(const std::string &path, const Record &record)
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            auto it = _entries.find(path);
+            if (it == _entries.end() || !it->second._recorded || !(it->second._record == record)) {
+                return false;
+            }
+        }
+
+        std::error_code error;
+        const std::uintmax_t size = std::filesystem::file_size(_root + "/" + path, error);
+        if (error || size != record._fileSize) {
+            return false;
+        }
+        _upToDateCount += 1;
+        return true;
+    }
+
+    bool ExtractionManifest::claim(const std::string &path, std::uint32_t archive)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto it = _entries.try_emplace(path, Entry{{}, false, archive}).first;
+        if (it->second._claimedBy == NO_ARCHIVE) {
+            it->second._claimedBy = archive;
+        }
+        return it->second._claimedBy == archive;
+    }
+
+    void ExtractionManifest::update(const std::string &path, const Record &record)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        Entry &entry = _entries.try_emplace(path, Entry{{}, false, record._archive}).first->second;
+        entry._record = record;
+        entry._recorded = true;
+    }
+
+    void ExtractionManifest::erase(const std::string &path)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (auto it = _entries.find(path); it != _entries.end()) {
+            it->second._recorded = false;
+        }
+    }
+
+    std::size_t ExtractionManifest::removeOrphans(const utils::PathFilter &filter)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        std::size_t removed = 0ull;
+        for (auto it = _entries.begin(); it != _entries.end();) {
+            const Entry &entry = it->second;
+            if (!entry._recorded || entry._claimedBy != NO_ARCHIVE || !_extracted.contains(entry._record._archive) || !filter.matches(it->first)) {
+                ++it;
+                continue;
+            }
+
+            std::error_code error;
+            std::filesystem::remove(_root + "/" + it->first, error);
+            if (error) {
+                spdlog::warn("Could not remove {}/{}: {}", _root, it->first, error.message());
+                ++it;
+                continue;
+            }
+            spdlog::info("Removed {}/{}", _root, it->first);
+            removed += 1;
+            it = _entries.erase(it);
+        }
+        return removed;
+    }
+
+    // Records are written grouped by archive and sorted by path, archives without any record are dropped
+    void ExtractionManifest::save() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        std::vector<const std::pair<const std::string, Entry> *> entries;
+        entries.reserve(_entries.size());
+        for (const auto &entry : _entries) {
+            if (entry.second._recorded) {
+                entries.push_back(&entry);
+            }
+        }
+        std::sort(entries.begin(), entries.end(), [](const auto *lhs, const auto *rhs) {
+            return lhs->second._record._archive != rhs->second._record._archive ? lhs->second._record._archive < rhs->second._record._archive : lhs->first < rhs->first;
+        });
+
+        const std::string path = _path();
+        const std::string temporaryPath = path + ".tmp";
+        {
+            std::ofstream file(temporaryPath, std::ios::out | std::ios::binary | std::ios::trunc);
+            file << HEADER << '\n';
+            std::uint32_t archive = static_cast<std::uint32_t>(_archives.size());
+            for (const auto *entry : entries) {
+                const Record &record = entry->second._record;
+                if (record._archive != archive) {
+                    archive = record._archive;
+                    file << "archive\t" << _archives[archive] << '\n';
+                }
+                file << spdlog::fmt_lib::format("{:08x}\t{:x}\t{:x}\t{:08x}\t{}\n", record._crcValue, record._fileZsize, record._fileSize, record._dataAddr, entry->first);
+            }
+            if (!file) {
+                std::error_code error;
+                std::filesystem::remove(temporaryPath, error);
+                throw std::ios_base::failure("Failed to write manifest: " + temporaryPath);
+            }
+        }
+
+        std::error_code error;
+        std::filesystem::rename(temporaryPath, path, error);
+        if (error) {
+            std::filesystem::remove(temporaryPath, error);
+            throw std::ios_base::failure("Failed to replace manifest: " + path);
+        }
+    }
+} // namespace ntt
+
+#endif // EXTRACTION_MANIFEST_HPP
@@ -0,0 +1,129 @@
+#ifndef FOOTER_LOCATOR_HPP
+#define FOOTER_LOCATOR_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <string_view>
+#include <vector>
+#include "spdlog/spdlog.h"
+#include "Utils/Utils.hpp"
+#include "IO/ArchiveSource.hpp"
+
+namespace ntt
+{
+    // Finds the chunk signature introducing the table of contents, which always runs to the end of the archive.
+    // A match is trusted when the big-endian size stored just before it reaches exactly the end of the file.
+    // Candidate offsets (e.g. a previously known position) are checked first, then the tail of the archive is
+    // searched backwards block by block, so only the searched window ever needs to be read.
+    class FooterLocator
+    {
+        public:
+            static constexpr std::size_t DEFAULT_TAIL_WINDOW = 64ull << 20;
+            static constexpr std::size_t BLOCK_SIZE = 1ull << 20;
+
+            FooterLocator(const ArchiveSource &source, std::string_view sign, std::size_t tailWindow = DEFAULT_TAIL_WINDOW);
+
+            // Returns the offset of the signature, or -1 if it is not within the tail window
+            std::ptrdiff_t locate(std::span<const std::size_t> candidates = {}) const;
+
+        private:
+            const ArchiveSource &_source;
+            std::string_view _sign;
+            std::size_t _tailWindow; // 0 searches the whole archive
+
+            bool _isValid(std::size_t offset) const;
+            static const std::byte *_findLast(const std::byte *begin, std::size_t size, std::byte value) noexcept;
+    };
+
+    FooterLocator::FooterLocator(const ArchiveSource &source, std::string_view sign, std::size_t tailWindow)
+        : _source(source), _sign(sign), _tailWindow(tailWindow)
+    {
+    }
+
+    bool FooterLocator::_isValid(std::size_t offset) const
+    {
+        const std::size_t fileSize = _source.getSize();
+        if (offset < 4 || offset > fileSize || _sign.size() > fileSize - offset) {
+            return false;
+        }
+
+        std::vector<std::byte> scratch;
+        std::span<const std::byte> bytes = _source.read(offset - 4, 4 + _sign.size(), scratch);
+        if (std::memcmp(bytes.data() + 4, _sign.data(), _sign.size()) != 0) {
+            return false;
+        }
+        std::uint32_t remainingSize = 0u;
+        remainingSize = utils::assignFromMemory(remainingSize, bytes[0], sizeof(std::uint32_t), true);
+        return remainingSize == fileSize - offset;
+    }
+
+    const std::byte *FooterLocator::_findLast(const std::byte *begin, std::size_t size, std::byte value) noexcept
+    {
+#if defined(__GLIBC__)
+        return static_cast<const std::byte *>(::memrchr(begin, std::to_integer<int>(value), size));
+#else
+        for (const std::byte *it = begin + size; it != begin; --it) {
+            if (*(it - 1) == value) {
+                return it - 1;
+            }
+        }
+        return nullptr;
+#endif
+    }
+
+    std::ptrdiff_t FooterLocator::locate(std::span<const std::size_t> candidates) const
+    {
+        const std::size_t fileSize = _source.getSize();
+        if (_sign.empty() || fileSize < _sign.size()) {
+            return -1;
+        }
+
+        for (const std::size_t candidate : candidates) {
+            if (_isValid(candidate)) {
+                return static_cast<std::ptrdiff_t>(candidate);
+            }
+        }
+
+        // Blocks overlap by the signature size minus one so that a match straddling two blocks is still seen
+        const std::size_t windowStart = _tailWindow == 0 || _tailWindow >= fileSize ? 0ull : fileSize - _tailWindow;
+        const std::byte first = static_cast<std::byte>(_sign[0]);
+        std::vector<std::byte> scratch;
+        std::ptrdiff_t unverified = -1;
+        std::size_t blockEnd = fileSize;
+
+        while (blockEnd > windowStart && blockEnd - windowStart >= _sign.size()) {
+            const std::size_t blockStart = blockEnd - windowStart > BLOCK_SIZE ? blockEnd - BLOCK_SIZE : windowStart;
+            std::span<const std::byte> block = _source.read(blockStart, blockEnd - blockStart, scratch);
+
+            std::size_t searchSize = block.size() - _sign.size() + 1;
+            while (const std::byte *hit = _findLast(block.data(), searchSize, first)) {
+                const std::size_t hitIndex = static_cast<std::size_t>(hit - block.data());
+                if (std::memcmp(hit, _sign.data(), _sign.size()) == 0) {
+                    const std::size_t offset = blockStart + hitIndex;
+                    if (_isValid(offset)) {
+                        return static_cast<std::ptrdiff_t>(offset);
+                    }
+                    if (unverified < 0) {
+                        unverified = static_cast<std::ptrdiff_t>(offset);
+                    }
+                }
+                searchSize = hitIndex;
+            }
+
+            if (blockStart == windowStart) {
+                break;
+            }
+            blockEnd = blockStart + _sign.size() - 1;
+        }
+
+        if (unverified >= 0) {
+            spdlog::warn("The size stored before {} at 0x{:x} does not match the end of {}.", _sign, unverified, _source.getPath());
+        }
+        return unverified;
+    }
+} // namespace ntt
+
+#endif // FOOTER_LOCATOR_HPP
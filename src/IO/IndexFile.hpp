@@ -0,0 +1,202 @@
+#ifndef INDEX_FILE_HPP
+#define INDEX_FILE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "spdlog/spdlog.h"
+#include "IO/ArchiveSource.hpp"
+
+namespace ntt
+{
+    // Sidecar file caching the resolved table of contents of an archive, so that reopening it skips
+    // the footer search, the name table walk and the CRC matching.
+    // Layout, in host byte order: Header, Entry records, the (hash, entry index) path index, then the string pool.
+    // An index is only trusted for the archive size, modification time and header bytes it was built from.
+    class IndexFile
+    {
+        public:
+            static constexpr char MAGIC[8] = {'N', 'T', 'T', 'I', 'N', 'D', 'E', 'X'};
+            static constexpr std::uint32_t VERSION = 1;
+            static constexpr std::uint32_t BYTE_ORDER_MARK = 0x01020304;
+            static constexpr std::size_t HASHED_HEADER = 0x20; // Bytes from the chunk header covered by the archive hash
+            static constexpr std::size_t HASHED_TAIL = 4096; // Bytes at the end of the archive covered by the archive hash
+
+            struct Header {
+                char _magic[8];
+                std::uint32_t _version;
+                std::uint32_t _byteOrder;
+                std::uint64_t _archiveSize;
+                std::int64_t _modificationTime;
+                std::uint64_t _headerOffset;
+                std::uint64_t _archiveHash;
+                std::uint32_t _entryCount;
+                std::uint32_t _fileCount; // Entries that are not directories, also the size of the path index
+                std::uint32_t _dirCount;
+                std::uint32_t _chunkVersion;
+                std::uint64_t _stringsSize;
+            };
+            struct Entry {
+                std::uint32_t _pathOffset;
+                std::uint32_t _pathLength;
+                std::uint32_t _nameLength; // The name is the end of the path
+                std::uint32_t _dataAddr;
+                std::uint32_t _fileSize;
+                std::uint32_t _fileZsize;
+                std::uint32_t _packedVer;
+                std::uint32_t _crcValue;
+                std::uint16_t _parentDirId;
+                std::uint16_t _dirId;
+                char _codec[4]; // Signature of compressed entries, zeros otherwise
+                std::uint8_t _isDir;
+                std::uint8_t _padding[3];
+            };
+            struct PathSlot {
+                std::uint32_t _hash;
+                std::uint32_t _fileIndex;
+            };
+
+            static std::string pathFor(const std::string &archivePath) { return archivePath + ".nttidx"; }
+            // Fingerprint of the bytes an index depends on the most: the chunk header and the end of the table
+            static std::uint64_t hashArchive(const ArchiveSource &archive, std::size_t headerOffset);
+
+            // isOpen() is false when there is no index at path, or when it is malformed
+            explicit IndexFile(const std::string &path);
+
+            bool isOpen() const noexcept { return _source != nullptr; }
+            const Header &getHeader() const noexcept { return _header; }
+            // Whether the index was built from this very archive
+            bool matches(const ArchiveSource &archive) const;
+
+            // Throw std::out_of_range past the end of their table
+            Entry getEntry(std::size_t index) const;
+            PathSlot getPathSlot(std::size_t index) const;
+            std::string_view getString(std::uint32_t offset, std::uint32_t length) const;
+
+            // Replaces the index at path atomically, throws std::ios_base::failure when it cannot be written
+            static void write(const std::string &path, const Header &header, std::span<const Entry> entries, std::span<const PathSlot> pathIndex, std::string_view strings);
+
+        private:
+            std::unique_ptr<ArchiveSource> _source;
+            std::vector<std::byte> _scratch; // Only used when the index is not mapped
+            std::span<const std::byte> _data;
+            Header _header{};
+
+            std::size_t _entriesOffset() const noexcept { return sizeof(Header); }
+            std::size_t _pathIndexOffset() const noexcept { return _entriesOffset() + _header._entryCount * sizeof(Entry); }
+            std::size_t _stringsOffset() const noexcept { return _pathIndexOffset() + _header._fileCount * sizeof(PathSlot); }
+    };
+
+    std::uint64_t IndexFile::hashArchive(const ArchiveSource &archive, std::size_t headerOffset)
+    {
+        std::uint64_t hash = 0xcbf29ce484222325ull; // FNV-1a
+        std::vector<std::byte> scratch;
+        auto hashRange = [&](std::size_t offset, std::size_t size) {
+            for (const std::byte b : archive.read(offset, size, scratch)) {
+                hash = (hash ^ std::to_integer<std::uint64_t>(b)) * 0x100000001b3ull;
+            }
+        };
+
+        const std::size_t size = archive.getSize();
+        if (headerOffset >= 4 && headerOffset <= size) {
+            hashRange(headerOffset - 4, std::min(HASHED_HEADER, size - (headerOffset - 4)));
+        }
+        hashRange(size - std::min(HASHED_TAIL, size), std::min(HASHED_TAIL, size));
+        return hash;
+    }
+
+    IndexFile::IndexFile(const std::string &path)
+    {
+        std::error_code error;
+        if (!std::filesystem::exists(path, error)) {
+            return;
+        }
+        try {
+            auto source = std::make_unique<ArchiveSource>(path);
+            if (source->getSize() < sizeof(Header)) {
+                throw std::out_of_range("too small");
+            }
+            _data = source->read(0, source->getSize(), _scratch);
+            std::memcpy(&_header, _data.data(), sizeof(Header));
+            if (std::memcmp(_header._magic, MAGIC, sizeof(MAGIC)) != 0 || _header._version != VERSION || _header._byteOrder != BYTE_ORDER_MARK) {
+                throw std::out_of_range("unknown format");
+            }
+            if (_header._fileCount > _header._entryCount || _stringsOffset() + _header._stringsSize != _data.size()) {
+                throw std::out_of_range("inconsistent sizes");
+            }
+            _source = std::move(source);
+        } catch (const std::exception &e) {
+            spdlog::warn("Ignoring the index {}: {}", path, e.what());
+            _data = {};
+            _scratch.clear();
+        }
+    }
+
+    bool IndexFile::matches(const ArchiveSource &archive) const
+    {
+        return isOpen() && _header._archiveSize == archive.getSize() && _header._modificationTime == archive.getModificationTime() &&
+            _header._archiveHash == hashArchive(archive, _header._headerOffset);
+    }
+
+    IndexFile::Entry IndexFile::getEntry(std::size_t index) const
+    {
+        if (index >= _header._entryCount) {
+            throw std::out_of_range("Index entry " + std::to_string(index) + " is out of bounds.");
+        }
+        Entry entry;
+        std::memcpy(&entry, _data.data() + _entriesOffset() + index * sizeof(Entry), sizeof(Entry));
+        return entry;
+    }
+
+    IndexFile::PathSlot IndexFile::getPathSlot(std::size_t index) const
+    {
+        if (index >= _header._fileCount) {
+            throw std::out_of_range("Index path slot " + std::to_string(index) + " is out of bounds.");
+        }
+        PathSlot slot;
+        std::memcpy(&slot, _data.data() + _pathIndexOffset() + index * sizeof(PathSlot), sizeof(PathSlot));
+        return slot;
+    }
+
+    std::string_view IndexFile::getString(std::uint32_t offset, std::uint32_t length) const
+    {
+        if (offset > _header._stringsSize || length > _header._stringsSize - offset) {
+            throw std::out_of_range("Index string at " + std::to_string(offset) + " is out of bounds.");
+        }
+        return {reinterpret_cast<const char *>(_data.data() + _stringsOffset() + offset), length};
+    }
+
+    void IndexFile::write(const std::string &path, const Header &header, std::span<const Entry> entries, std::span<const PathSlot> pathIndex, std::string_view strings)
+    {
+        const std::string temporaryPath = path + ".tmp";
+        {
+            std::ofstream file(temporaryPath, std::ios::out | std::ios::binary | std::ios::trunc);
+            file.write(reinterpret_cast<const char *>(&header), sizeof(Header));
+            file.write(reinterpret_cast<const char *>(entries.data()), static_cast<std::streamsize>(entries.size_bytes()));
+            file.write(reinterpret_cast<const char *>(pathIndex.data()), static_cast<std::streamsize>(pathIndex.size_bytes()));
+            file.write(strings.data(), static_cast<std::streamsize>(strings.size()));
+            if (!file) {
+                std::error_code error;
+                std::filesystem::remove(temporaryPath, error);
+                throw std::ios_base::failure("Failed to write index: " + temporaryPath);
+            }
+        }
+
+        std::error_code error;
+        std::filesystem::rename(temporaryPath, path, error);
+        if (error) {
+            std::filesystem::remove(temporaryPath, error);
+            throw std::ios_base::failure("Failed to replace index: " + path);
+        }
+    }
+} // namespace ntt
+
+#endif // INDEX_FILE_HPP
@@ -0,0 +1,72 @@
+#ifndef OUTPUT_HPP
+#define OUTPUT_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace ntt
+{
+    // Destination of extracted entries. Directories are created synchronously, file writes are queued:
+    // the completion runs once the data is no longer needed, possibly on another thread.
+    // Entries too large to be buffered are written synchronously through a stream instead.
+    class Output
+    {
+        public:
+            enum class Status {
+                Written,
+                AlreadyExists,
+                Failed
+            };
+            struct Result {
+                Status _status;
+                std::string _path; // Where the entry went
+                std::string _error; // Set when _status is Failed
+            };
+            struct Stats {
+                std::size_t _files{0};
+                std::size_t _directories{0};
+                std::size_t _bytes{0};
+                std::size_t _syscalls{0};
+                double _seconds{0.0};
+            };
+            using Completion = std::function<void(const Result &result)>;
+
+            class Stream
+            {
+                public:
+                    virtual ~Stream() = default;
+
+                    // Failures are remembered and reported by close()
+                    virtual void write(std::span<const std::byte> data) = 0;
+                    // Drops everything written so far
+                    virtual void rewind() = 0;
+                    virtual Result close() = 0;
+            };
+
+            virtual ~Output() = default;
+
+            virtual Result createDirectory(const std::string &path) = 0;
+            // data must stay valid until onDone runs, unless it points into owned which is then kept alive by the output
+            virtual void write(const std::string &path, std::span<const std::byte> data, std::vector<std::byte> owned, Completion onDone) = 0;
+            // Opens path for size bytes of sequential writes. stream is only set when the result is Written.
+            virtual Result openStream(const std::string &path, std::size_t size, std::unique_ptr<Stream> &stream) = 0;
+            // Writes path as a link to existingPath, a file this output already wrote: a copy sharing its storage when clone is set,
+            // a hard link otherwise. Failed when links of that kind cannot be made here.
+            virtual Result link(const std::string &path, const std::string &, bool) { return {Status::Failed, path, "Links are not supported by this output"}; }
+            // Blocks until every queued write completed
+            virtual void wait() = 0;
+            // Completes the output once the last write was waited for, nothing can be written afterwards
+            virtual void finish() {}
+
+            // Buffer to decode the next entry into, possibly recycled from a completed write
+            virtual std::vector<std::byte> takeBuffer() { return {}; }
+            virtual Stats getStats() const = 0;
+    };
+} // namespace ntt
+
+#endif // OUTPUT_HPP
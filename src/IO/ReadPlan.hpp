@@ -0,0 +1,102 @@
+#ifndef READ_PLAN_HPP
+#define READ_PLAN_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <span>
+#include <vector>
+
+namespace ntt
+{
+    // Byte ranges of an archive in ascending offset, merged into extents so that the archive is read front to back
+    // in a few large reads instead of a seek per entry. A range joins the extent before it when the hole in between is
+    // at most MAX_GAP, which is read through, and the extent stays within MAX_EXTENT. Ranges added alone get their own extent.
+    class ReadPlan
+    {
+        public:
+            static constexpr std::size_t MAX_GAP = 64ull << 10;
+            static constexpr std::size_t MAX_EXTENT = 4ull << 20;
+
+            struct Range {
+                std::size_t _offset;
+                std::size_t _size;
+                std::size_t _id; // Given by the caller
+                bool _alone;
+            };
+            struct Extent {
+                std::size_t _offset;
+                std::size_t _size;
+                std::size_t _firstRange;
+                std::size_t _rangeCount;
+            };
+
+            void reserve(std::size_t rangeCount) { _ranges.reserve(rangeCount); }
+            void add(std::size_t offset, std::size_t size, std::size_t id, bool alone = false) { _ranges.push_back({offset, size, id, alone}); }
+            // Sorts the ranges and merges them, call once every range was added
+            void build();
+
+            std::size_t getRangeCount() const noexcept { return _ranges.size(); }
+            const std::vector<Extent> &getExtents() const noexcept { return _extents; }
+            // The ranges of an extent, in ascending offset
+            std::span<const Range> getRanges(const Extent &extent) const noexcept { return std::span<const Range>(_ranges).subspan(extent._firstRange, extent._rangeCount); }
+
+        private:
+            std::vector<Range> _ranges;
+            std::vector<Extent> _extents;
+    };
+
+    // Reads as concurrent workers issue them. A read is sequential when it starts at most ReadPlan::MAX_GAP past
+    // the end of the read issued just before it, whichever worker issued that one. The first read has nothing to seek from.
+    class ReadTracker
+    {
+        public:
+            void record(std::size_t offset, std::size_t size) noexcept;
+
+            std::size_t getReads() const noexcept { return _reads; }
+            std::size_t getSequentialReads() const noexcept { return _sequentialReads; }
+            std::size_t getBytes() const noexcept { return _bytes; }
+
+        private:
+            static constexpr std::size_t NO_READ = ~std::size_t{0};
+
+            std::atomic<std::size_t> _lastEnd{NO_READ};
+            std::atomic<std::size_t> _reads{0};
+            std::atomic<std::size_t> _sequentialReads{0};
+            std::atomic<std::size_t> _bytes{0};
+    };
+
+    void ReadPlan::build()
+    {
+        std::stable_sort(_ranges.begin(), _ranges.end(), [](const Range &lhs, const Range &rhs) { return lhs._offset < rhs._offset; });
+
+        _extents.clear();
+        std::size_t extentEnd = 0ull;
+        for (std::size_t rangeIndex = 0ull; rangeIndex < _ranges.size(); ++rangeIndex) {
+            const Range &range = _ranges[rangeIndex];
+            const std::size_t rangeEnd = range._offset + range._size;
+            if (!_extents.empty() && !range._alone && !_ranges[rangeIndex - 1]._alone && range._offset <= extentEnd + MAX_GAP
+                && std::max(extentEnd, rangeEnd) - _extents.back()._offset <= MAX_EXTENT) {
+                // Entries may share their data, so a range can end before the extent does
+                extentEnd = std::max(extentEnd, rangeEnd);
+                _extents.back()._size = extentEnd - _extents.back()._offset;
+                _extents.back()._rangeCount += 1;
+                continue;
+            }
+            _extents.push_back({range._offset, range._size, rangeIndex, 1ull});
+            extentEnd = rangeEnd;
+        }
+    }
+
+    void ReadTracker::record(std::size_t offset, std::size_t size) noexcept
+    {
+        const std::size_t previousEnd = _lastEnd.exchange(offset + size);
+        if (previousEnd == NO_READ || (offset >= previousEnd && offset - previousEnd <= ReadPlan::MAX_GAP)) {
+            _sequentialReads += 1;
+        }
+        _reads += 1;
+        _bytes += size;
+    }
+} // namespace ntt
+
+#endif // READ_PLAN_HPP
@@ -0,0 +1,477 @@
+#ifndef TAR_OUTPUT_HPP
+#define TAR_OUTPUT_HPP
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ios>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+#include "Utils/ThreadPool.hpp"
+#include "IO/Output.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+    #include <fcntl.h>
+    #include <unistd.h>
+    #ifndef NTT_POSIX_IO
+        #define NTT_POSIX_IO 1
+    #endif
+#elif defined(_WIN32)
+    #include <fcntl.h>
+    #include <io.h>
+#endif
+
+namespace ntt
+{
+    // Writes entries as one tar stream, to a file or to the standard output, instead of a file per entry.
+    // A single writer thread appends the entries in the order their writes come in, which is the data offset order
+    // of the scheduler, through a large buffer: the filesystem sees one sequential write and no per-entry call.
+    // Paths too long for a ustar header get a pax extended header, a path already in the stream is AlreadyExists.
+    // Streams hold the tar stream from openStream() until they are closed. The stream cannot seek back, so
+    // a rewound stream is zero filled up to its announced size and reported Failed.
+    class TarOutput : public Output
+    {
+        public:
+            static constexpr std::string_view STANDARD_OUTPUT = "-";
+
+            // path is STANDARD_OUTPUT for the standard output. Throws std::ios_base::failure when it cannot be created.
+            explicit TarOutput(const std::string &path, std::size_t maxPending = 64ull);
+            ~TarOutput() override;
+
+            Result createDirectory(const std::string &path) override;
+            void write(const std::string &path, std::span<const std::byte> data, std::vector<std::byte> owned, Completion onDone) override;
+            Result openStream(const std::string &path, std::size_t size, std::unique_ptr<Stream> &stream) override;
+            // A hard link entry whatever clone says, tar has no shared storage
+            Result link(const std::string &path, const std::string &existingPath, bool clone) override;
+            void wait() override;
+            // Ends the archive and flushes it, throws std::ios_base::failure when anything could not be written
+            void finish() override;
+
+            std::vector<std::byte> takeBuffer() override;
+            Stats getStats() const override;
+
+        private:
+            static constexpr std::size_t BLOCK_SIZE = 512ull;
+            static constexpr std::size_t BUFFER_SIZE = 1ull << 20; // Smaller writes are gathered
+            static constexpr std::size_t KEEP_BUFFER_SIZE = 64ull << 20; // Larger buffers are not recycled
+
+            class TarStream : public Stream
+            {
+                public:
+                    TarStream(TarOutput &output, std::unique_lock<std::mutex> lock, const std::string &path, std::size_t size)
+                        : _output(output), _lock(std::move(lock)), _path(path), _size(size) {}
+                    ~TarStream() override;
+
+                    void write(std::span<const std::byte> data) override;
+                    void rewind() override;
+                    Result close() override;
+
+                private:
+                    TarOutput &_output;
+                    std::unique_lock<std::mutex> _lock; // On _output._streamMutex
+                    std::string _path;
+                    std::size_t _size;
+                    std::size_t _written{0};
+                    bool _failed{false};
+                    bool _closed{false};
+            };
+
+            const std::string _path;
+            const std::size_t _maxPending;
+            const std::chrono::steady_clock::time_point _start;
+            const std::uint64_t _modificationTime; // Of every entry, in seconds since the epoch
+#ifdef NTT_POSIX_IO
+            int _fd{-1};
+#else
+            std::FILE *_file{nullptr};
+#endif
+            std::mutex _streamMutex; // Held while an entry is appended, from its header to its padding
+            std::vector<std::byte> _buffer;
+            std::string _error; // First write error, nothing is written after it
+            bool _finished{false};
+            std::mutex _namesMutex;
+            std::unordered_set<std::string> _names; // Already in the stream, directories with a trailing '/'
+            std::mutex _pendingMutex;
+            std::condition_variable _pendingCondition;
+            std::size_t _pending{0};
+            std::mutex _bufferMutex;
+            std::vector<std::vector<std::byte>> _buffers;
+            std::atomic<std::size_t> _fileCount{0};
+            std::atomic<std::size_t> _directoryCount{0};
+            std::atomic<std::size_t> _byteCount{0};
+            std::atomic<std::size_t> _syscallCount{0};
+            utils::ThreadPool _writer{1}; // Last, so that it is joined before the state above goes away
+
+            bool _claim(const std::string &name);
+            // The helpers below need _streamMutex
+            void _appendHeader(const std::string &name, std::size_t size, char type, const std::string &linkName = {});
+            void _append(std::span<const std::byte> data);
+            void _appendZeros(std::size_t count);
+            void _pad(std::size_t size);
+            void _flush();
+            void _writeOut(const std::byte *data, std::size_t size);
+            Result _writeEntry(const std::string &path, std::span<const std::byte> data);
+            Result _failure(const std::string &path) const { return {Status::Failed, path, "Failed to write " + path + " to " + _path + ": " + _error}; }
+    };
+
+    TarOutput::TarOutput(const std::string &path, std::size_t maxPending)
+        : _path(path), _maxPending(std::max<std::size_t>(maxPending, 1ull)), _start(std::chrono::steady_clock::now()),
+          _modificationTime(static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count()))
+    {
+#ifdef NTT_POSIX_IO
+        _fd = path == STANDARD_OUTPUT ? STDOUT_FILENO : ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (_fd < 0) {
+            throw std::ios_base::failure("Failed to create " + path + ": " + std::strerror(errno));
+        }
+#else
+        if (path == STANDARD_OUTPUT) {
+    #ifdef _WIN32
+            _setmode(_fileno(stdout), _O_BINARY);
+    #endif
+            _file = stdout;
+        } else {
+            _file = std::fopen(path.c_str(), "wb");
+        }
+        if (_file == nullptr) {
+            throw std::ios_base::failure("Failed to create " + path);
+        }
+#endif
+        _buffer.reserve(BUFFER_SIZE);
+    }
+
+    TarOutput::~TarOutput()
+    {
+        wait();
+#ifdef NTT_POSIX_IO
+        if (_fd >= 0 && _path != STANDARD_OUTPUT) {
+            ::close(_fd);
+        }
+#else
+        if (_file != nullptr && _path != STANDARD_OUTPUT) {
+            std::fclose(_file);
+        }
+#endif
+    }
+
+    bool TarOutput::_claim(const std::string &name)
+    {
+        std::lock_guard<std::mutex> lock(_namesMutex);
+        return _names.insert(name).second;
+    }
+
+    void TarOutput::_writeOut(const std::byte *data, std::size_t size)
+    {
+        if (!_error.empty()) {
+            return;
+        }
+#ifdef NTT_POSIX_IO
+        while (size != 0) {
+            _syscallCount += 1;
+            const ssize_t count = ::write(_fd, data, size);
+            if (count < 0 && errno == EINTR) {
+                continue;
+            }
+            if (count <= 0) {
+                _error = count < 0 ? std::strerror(errno) : "nothing written";
+                return;
+            }
+            data += count;
+            size -= static_cast<std::size_t>(count);
+        }
+#else
+        _syscallCount += 1;
+        if (std::fwrite(data, 1, size, _file) != size) {
+            _error = "write error";
+        }
+#endif
+    }
+
+    void TarOutput::_flush()
+    {
+        _writeOut(_buffer.data(), _buffer.size());
+        _buffer.clear();
+    }
+
+    // Data that would not fit in the buffer anyway goes out directly
+    void TarOutput::_append(std::span<const std::byte> data)
+    {
+        if (_buffer.size() + data.size() > BUFFER_SIZE) {
+            _flush();
+        }
+        if (data.size() >= BUFFER_SIZE) {
+            _writeOut(data.data(), data.size());
+        } else {
+            _buffer.insert(_buffer.end(), data.begin(), data.end());
+        }
+    }
+
+    void TarOutput::_appendZeros(std::size_t count)
+    {
+        static constexpr std::array<std::byte, BLOCK_SIZE> zeros{};
+        for (; count > BLOCK_SIZE; count -= BLOCK_SIZE) {
+            _append(zeros);
+        }
+        _append(std::span<const std::byte>(zeros.data(), count));
+    }
+
+    void TarOutput::_pad(std::size_t size)
+    {
+        if (size % BLOCK_SIZE != 0) {
+            _appendZeros(BLOCK_SIZE - size % BLOCK_SIZE);
+        }
+    }
+
+    // ustar header, preceded by a pax header holding the path or the link target when they do not fit their fields
+    void TarOutput::_appendHeader(const std::string &name, std::size_t size, char type, const std::string &linkName)
+    {
+        auto octal = [](char *field, std::size_t width, std::uint64_t value) {
+            for (std::size_t digit = width - 1; digit-- > 0; value >>= 3) {
+                field[digit] = static_cast<char>('0' + (value & 7));
+            }
+            field[width - 1] = '\0';
+        };
+        auto header = [&](std::string_view prefix, std::string_view fieldName, std::size_t fieldSize, char fieldType, std::string_view fieldLink) {
+            std::array<char, BLOCK_SIZE> block{};
+            std::memcpy(block.data(), fieldName.data(), std::min<std::size_t>(fieldName.size(), 100));
+            octal(block.data() + 100, 8, fieldType == '5' ? 0755 : 0644);
+            octal(block.data() + 108, 8, 0);
+            octal(block.data() + 116, 8, 0);
+            octal(block.data() + 124, 12, fieldSize);
+            octal(block.data() + 136, 12, _modificationTime);
+            std::memset(block.data() + 148, ' ', 8);
+            block[156] = fieldType;
+            std::memcpy(block.data() + 157, fieldLink.data(), std::min<std::size_t>(fieldLink.size(), 100));
+            std::memcpy(block.data() + 257, "ustar", 6);
+            std::memcpy(block.data() + 263, "00", 2);
+            std::memcpy(block.data() + 345, prefix.data(), prefix.size());
+            std::uint32_t checksum = 0u;
+            for (const char c : block) {
+                checksum += static_cast<unsigned char>(c);
+            }
+            octal(block.data() + 148, 7, checksum);
+            _append(std::as_bytes(std::span<const char>(block)));
+        };
+        // A pax record is "<length> <key>=<value>\n", its length counting its own digits
+        auto paxRecord = [](std::string_view key, const std::string &value) {
+            const std::string body = " " + std::string(key) + "=" + value + "\n";
+            std::size_t length = body.size() + 1;
+            while (std::to_string(length).size() + body.size() != length) {
+                length = std::to_string(length).size() + body.size();
+            }
+            return std::to_string(length) + body;
+        };
+
+        std::string_view prefix;
+        std::string_view fieldName = name;
+        std::string records;
+        if (name.size() > 100) {
+            // The prefix ends at a separator, the name after it has to fit its 100 bytes
+            std::size_t split = std::min<std::size_t>(name.size() - 1, 155);
+            for (; split != 0 && name.size() - split - 1 <= 100; --split) {
+                if (name[split] == '/' && split != name.size() - 1) {
+                    prefix = std::string_view(name).substr(0, split);
+                    fieldName = std::string_view(name).substr(split + 1);
+                    break;
+                }
+            }
+            if (prefix.empty()) {
+                records += paxRecord("path", name);
+            }
+        }
+        if (linkName.size() > 100) {
+            records += paxRecord("linkpath", linkName);
+        }
+        if (!records.empty()) {
+            header({}, "././@PaxHeader", records.size(), 'x', {});
+            _append(std::as_bytes(std::span<const char>(records)));
+            _pad(records.size());
+        }
+        header(prefix, fieldName, size, type, linkName);
+    }
+
+    Output::Result TarOutput::createDirectory(const std::string &path)
+    {
+        if (!_claim(path + "/")) {
+            return {Status::AlreadyExists, path, {}};
+        }
+        std::lock_guard<std::mutex> lock(_streamMutex);
+        _appendHeader(path + "/", 0ull, '5');
+        if (!_error.empty()) {
+            return _failure(path);
+        }
+        _directoryCount += 1;
+        return {Status::Written, path, {}};
+    }
+
+    Output::Result TarOutput::_writeEntry(const std::string &path, std::span<const std::byte> data)
+    {
+        std::lock_guard<std::mutex> lock(_streamMutex);
+        _appendHeader(path, data.size(), '0');
+        _append(data);
+        _pad(data.size());
+        if (!_error.empty()) {
+            return _failure(path);
+        }
+        _fileCount += 1;
+        _byteCount += data.size();
+        return {Status::Written, path, {}};
+    }
+
+    void TarOutput::write(const std::string &path, std::span<const std::byte> data, std::vector<std::byte> owned, Completion onDone)
+    {
+        if (!_claim(path)) {
+            onDone({Status::AlreadyExists, path, {}});
+            return;
+        }
+        {
+            std::unique_lock<std::mutex> lock(_pendingMutex);
+            _pendingCondition.wait(lock, [this]() { return _pending < _maxPending; });
+            _pending += 1;
+        }
+
+        _writer.submit([this, path, data, owned = std::move(owned), onDone = std::move(onDone)](std::size_t) mutable {
+            const Result result = _writeEntry(path, data);
+            {
+                std::lock_guard<std::mutex> lock(_pendingMutex);
+                _pending -= 1;
+            }
+            _pendingCondition.notify_all();
+
+            if (owned.capacity() != 0 && owned.capacity() <= KEEP_BUFFER_SIZE) {
+                owned.clear();
+                std::lock_guard<std::mutex> lock(_bufferMutex);
+                if (_buffers.size() < _maxPending) {
+                    _buffers.push_back(std::move(owned));
+                }
+            }
+            onDone(result);
+        });
+    }
+
+    // existingPath went through write() or openStream() before, its entry is already in the stream
+    Output::Result TarOutput::link(const std::string &path, const std::string &existingPath, bool)
+    {
+        if (!_claim(path)) {
+            return {Status::AlreadyExists, path, {}};
+        }
+        std::lock_guard<std::mutex> lock(_streamMutex);
+        _appendHeader(path, 0ull, '1', existingPath);
+        if (!_error.empty()) {
+            return _failure(path);
+        }
+        _fileCount += 1;
+        return {Status::Written, path, {}};
+    }
+
+    Output::Result TarOutput::openStream(const std::string &path, std::size_t size, std::unique_ptr<Stream> &stream)
+    {
+        if (!_claim(path)) {
+            return {Status::AlreadyExists, path, {}};
+        }
+        std::unique_lock<std::mutex> lock(_streamMutex);
+        _appendHeader(path, size, '0');
+        if (!_error.empty()) {
+            return _failure(path);
+        }
+        stream = std::make_unique<TarStream>(*this, std::move(lock), path, size);
+        return {Status::Written, path, {}};
+    }
+
+    TarOutput::TarStream::~TarStream()
+    {
+        if (!_closed) {
+            close();
+        }
+    }
+
+    void TarOutput::TarStream::write(std::span<const std::byte> data)
+    {
+        if (_failed) {
+            return;
+        }
+        if (data.size() > _size - _written) {
+            _failed = true;
+            data = data.first(_size - _written);
+        }
+        _output._append(data);
+        _written += data.size();
+    }
+
+    void TarOutput::TarStream::rewind()
+    {
+        _failed = true;
+    }
+
+    // The entry always ends up with the size its header announced, so that the rest of the archive stays readable
+    TarOutput::Result TarOutput::TarStream::close()
+    {
+        _closed = true;
+        _output._appendZeros(_size - _written);
+        _output._pad(_size);
+        const bool failed = _failed || !_output._error.empty();
+        const std::string error = _output._error;
+        _lock.unlock();
+
+        if (failed) {
+            return {Status::Failed, _path, "Failed to write " + _path + " to " + _output._path + ": " + (error.empty() ? "its data could not be streamed in one pass" : error)};
+        }
+        _output._fileCount += 1;
+        _output._byteCount += _written;
+        return {Status::Written, _path, {}};
+    }
+
+    void TarOutput::wait()
+    {
+        _writer.wait();
+    }
+
+    // Two zero blocks end a tar archive
+    void TarOutput::finish()
+    {
+        wait();
+        std::lock_guard<std::mutex> lock(_streamMutex);
+        if (!_finished) {
+            _finished = true;
+            _appendZeros(2 * BLOCK_SIZE);
+            _flush();
+#ifndef NTT_POSIX_IO
+            if (std::fflush(_file) != 0 && _error.empty()) {
+                _error = "write error";
+            }
+#endif
+        }
+        if (!_error.empty()) {
+            throw std::ios_base::failure("Failed to write " + _path + ": " + _error);
+        }
+    }
+
+    std::vector<std::byte> TarOutput::takeBuffer()
+    {
+        std::lock_guard<std::mutex> lock(_bufferMutex);
+        if (_buffers.empty()) {
+            return {};
+        }
+        std::vector<std::byte> buffer = std::move(_buffers.back());
+        _buffers.pop_back();
+        return buffer;
+    }
+
+    Output::Stats TarOutput::getStats() const
+    {
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - _start;
+        return {_fileCount.load(), _directoryCount.load(), _byteCount.load(), _syscallCount.load(), elapsed.count()};
+    }
+} // namespace ntt
+
+#endif // TAR_OUTPUT_HPP
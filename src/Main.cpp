@@ -1,33 +1,270 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "CLI/Options.hpp"
 #include "DAT/Dat.hpp"
+#include "DAT/ArchiveDiff.hpp"
+#include "DAT/DatWriter.hpp"
+#include "IO/DirectoryOutput.hpp"
+#include "IO/TarOutput.hpp"
+#include "IO/ExtractionManifest.hpp"
+#include "IO/DedupIndex.hpp"
+#include "Utils/ThreadPool.hpp"
+#include "Utils/MemoryBudget.hpp"
+#include "Utils/Logging.hpp"
+#include "Utils/Stats.hpp"
 #include "spdlog/spdlog.h"
 
-int main(int argc, const char *argv[]) {
-    if (argc < 2) {
-        spdlog::error("Error: No file provided at command line.");
-        return 1;
+// Opens an archive and resolves its table of contents, from its sidecar index when it is up to date
+static std::shared_ptr<ntt::Dat> openArchive(const std::string &inputFile, const cli::Options &options, utils::Stats *stats)
+{
+    std::shared_ptr<ntt::Dat> datFile;
+    {
+        utils::Stats::Timer timer(stats, "open");
+        datFile = std::make_shared<ntt::Dat>(inputFile);
+        datFile->readMagicHeader();
+        timer.setBytes(datFile->getFileSize(), 0ull);
+    }
+
+    // An up to date index replaces every step up to the CRC matching, verification checks the archive itself
+    const std::string indexPath = ntt::IndexFile::pathFor(inputFile);
+    bool indexed = false;
+    if (options._readIndex && !options._verify) {
+        utils::Stats::Timer timer(stats, "index_load");
+        indexed = datFile->loadIndex(indexPath);
+        timer.setEntries(datFile->getEntryCount());
     }
 
+    if (!indexed) {
+        std::ptrdiff_t offset = -1;
+        {
+            utils::Stats::Timer timer(stats, "locate");
+            offset = datFile->getFilesChunkOffset(".CC40TAD", options._footerWindow);
+        }
+        if (offset < 0) {
+            throw std::out_of_range("No .CC40TAD chunk found at the end of " + inputFile);
+        }
+
+        {
+            utils::Stats::Timer timer(stats, "parse");
+            datFile->setFilesChunkHeader(offset);
+            datFile->parseFilesChunk();
+            datFile->getFilesOffset();
+            timer.setEntries(datFile->getEntryCount());
+        }
+        {
+            utils::Stats::Timer timer(stats, "crc");
+            datFile->setCRCdatabase();
+            datFile->computeCRC();
+            timer.setEntries(datFile->getEntryCount());
+        }
+        if (options._writeIndex) {
+            utils::Stats::Timer timer(stats, "index_save");
+            datFile->saveIndex(indexPath);
+        }
+    }
+    return datFile;
+}
+
+// Prints the differences between the two archives of the diff command as JSON
+static bool diffArchives(const cli::Options &options, utils::ThreadPool &pool, utils::Stats *stats)
+{
     try {
-        for (std::size_t fileIndex = 1; fileIndex < argc; ++fileIndex) {
-            ntt::Dat datFile(argv[fileIndex]);
-
-            datFile.readMagicHeader();
-            std::ptrdiff_t offset = datFile.getFilesChunkOffset(".CC40TAD");
-
-            // Need to handle errors
-            datFile.setFilesChunkHeader(offset);
-            datFile.parseFilesChunk();
-            datFile.getFilesOffset();
-            datFile.setCRCdatabase();
-            datFile.computeCRC();
-            datFile.readFilesBuffer();
-            datFile.decompressFiles();
-        }
-        return 0;
+        std::shared_ptr<ntt::Dat> oldDat = openArchive(options._commandArgs[0], options, stats);
+        std::shared_ptr<ntt::Dat> newDat = openArchive(options._commandArgs[1], options, stats);
+        utils::Stats::Timer timer(stats, "diff");
+        const ntt::ArchiveDiff diff = ntt::ArchiveDiff::compare(*oldDat, *newDat, pool, options._filter);
+        spdlog::fmt_lib::print("{}", diff.toJson());
     } catch (const std::ios_base::failure &e) {
         spdlog::error("Error: {}", e.what());
+        return false;
     } catch (const std::out_of_range &e) {
         spdlog::error("Error: {}", e.what());
+        return false;
+    }
+    return true;
+}
+
+// Builds the archive of the pack command from a directory tree
+static bool packArchive(const cli::Options &options, utils::ThreadPool &pool, utils::Stats *stats)
+{
+    try {
+        const ntt::DatWriter writer(options._commandArgs[0], options._level);
+        spdlog::info("Packing {} files and {} directories from {}", writer.getFileCount(), writer.getDirectoryCount(), options._commandArgs[0]);
+        const ntt::DatWriter::Summary summary = writer.write(options._commandArgs[1], pool, stats);
+        spdlog::info("Packed {:.1f} MB into {:.1f} MB: {}", summary._bytesIn / 1048576.0, summary._bytesOut / 1048576.0, options._commandArgs[1]);
+    } catch (const std::ios_base::failure &e) {
+        spdlog::error("Error: {}", e.what());
+        return false;
+    } catch (const std::runtime_error &e) {
+        spdlog::error("Error: {}", e.what());
+        return false;
+    } catch (const std::out_of_range &e) {
+        spdlog::error("Error: {}", e.what());
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, const char *argv[]) {
+    cli::Options options;
+
+    try {
+        options = cli::parseOptions(argc, argv);
+    } catch (const std::invalid_argument &e) {
+        spdlog::error("Error: {}", e.what());
+        return 1;
+    }
+
+    if (options._inputFiles.empty() && options._command.empty()) {
+        spdlog::error("Error: No file provided at command line.");
+        return 1;
+    }
+    if (options._list || options._command == "diff") {
+        spdlog::set_level(std::max(options._logLevel, spdlog::level::warn)); // Keep stdout for the listing or the diff
+    } else {
+        utils::startAsyncLogging(options._logLevel, options._stdout);
+    }
+
+    // Every archive shares the same workers: while one is being parsed here,
+    // the entries of the previous ones are extracted by the pool.
+    utils::ThreadPool pool(options._jobs);
+    utils::MemoryBudget budget(options._maxMemory);
+    std::unique_ptr<ntt::Output> output;
+    std::unique_ptr<ntt::ExtractionManifest> manifest;
+    std::unique_ptr<ntt::DedupIndex> dedup;
+    std::atomic<bool> failed = false;
+    utils::Stats stats;
+    utils::Stats *const statsOrNull = options._statsPath.empty() ? nullptr : &stats;
+    const auto start = std::chrono::steady_clock::now();
+
+    if (!options._list && !options._verify && options._command.empty() && options._format == "tar") {
+        try {
+            output = std::make_unique<ntt::TarOutput>(options._stdout ? std::string(ntt::TarOutput::STANDARD_OUTPUT) : "./Content.tar");
+        } catch (const std::ios_base::failure &e) {
+            spdlog::error("Error: {}", e.what());
+            utils::stopAsyncLogging(options._stdout);
+            return 1;
+        }
+    } else if (!options._list && !options._verify && options._command.empty()) {
+        auto directoryOutput = std::make_unique<ntt::DirectoryOutput>("./Content", options._writers);
+        if (options._incremental) {
+            directoryOutput->setReplaceExisting(true);
+            manifest = std::make_unique<ntt::ExtractionManifest>("./Content");
+        }
+        output = std::move(directoryOutput);
+    }
+    if (output && !options._dedup.empty()) {
+        dedup = std::make_unique<ntt::DedupIndex>(options._dedup == "clone" ? ntt::DedupIndex::Mode::Reflink : ntt::DedupIndex::Mode::HardLink);
+    }
+
+    if (options._command == "diff") {
+        failed = !diffArchives(options, pool, statsOrNull);
+    } else if (options._command == "pack") {
+        failed = !packArchive(options, pool, statsOrNull);
+    }
+
+    for (const std::string &inputFile : options._inputFiles) {
+        try {
+            std::shared_ptr<ntt::Dat> datFile = openArchive(inputFile, options, statsOrNull);
+
+            if (options._list) {
+                if (options._inputFiles.size() > 1) {
+                    spdlog::fmt_lib::print("{}:\n", inputFile);
+                }
+                for (const auto &entry : datFile->listFiles(options._filter)) {
+                    spdlog::fmt_lib::print("{:08x} {:>10} {:>10} {:<6} {}\n", entry._dataAddr, entry._fileZsize, entry._fileSize, entry._codec, entry._pathName);
+                }
+                continue;
+            }
+
+            if (options._verify) {
+                utils::Stats::Timer timer(statsOrNull, "verify");
+                if (const std::size_t failures = datFile->verifyFiles(pool, options._filter, statsOrNull); failures != 0) {
+                    spdlog::error("Error: {} files of {} failed verification", failures, inputFile);
+                    failed = true;
+                }
+                continue;
+            }
+
+            {
+                utils::Stats::Timer timer(statsOrNull, "read_buffers");
+                datFile->readFilesBuffer();
+            }
+
+            // Blocks while the archives already in flight use up the memory budget
+            utils::Stats::Timer timer(statsOrNull, "schedule");
+            const std::size_t footprint = datFile->getMemoryFootprint();
+            budget.acquireArchive(footprint);
+            datFile->scheduleFiles(pool, *output, budget, [datFile, footprint, &budget]() mutable {
+                budget.releaseArchive(footprint);
+                datFile.reset();
+            }, options._filter, statsOrNull, manifest.get(), dedup.get());
+        } catch (const std::ios_base::failure &e) {
+            spdlog::error("Error: {}", e.what());
+            failed = true;
+        } catch (const std::out_of_range &e) {
+            spdlog::error("Error: {}", e.what());
+            failed = true;
+        }
+    }
+
+    pool.wait();
+    if (output) {
+        output->wait();
+        try {
+            output->finish();
+        } catch (const std::ios_base::failure &e) {
+            spdlog::error("Error: {}", e.what());
+            failed = true;
+        }
+        const ntt::Output::Stats outputStats = output->getStats();
+        spdlog::info("Wrote {} files and {} directories, {:.1f} MB in {:.2f} s ({:.1f} MB/s, {} syscalls)", outputStats._files, outputStats._directories,
+            outputStats._bytes / 1048576.0, outputStats._seconds, outputStats._bytes / 1048576.0 / std::max(outputStats._seconds, 1e-9), outputStats._syscalls);
+        stats.addStage("write", {outputStats._seconds, outputStats._bytes, outputStats._bytes, outputStats._files});
+        stats.setValue("syscalls", static_cast<double>(outputStats._syscalls));
+        if (dedup) {
+            spdlog::info("Linked {} duplicate files, {:.1f} MB not written", dedup->getLinkedFiles(), dedup->getLinkedBytes() / 1048576.0);
+            stats.setValue("linked", static_cast<double>(dedup->getLinkedFiles()));
+            stats.setValue("linked_bytes", static_cast<double>(dedup->getLinkedBytes()));
+        }
+        if (manifest) {
+            const std::size_t removed = manifest->removeOrphans(options._filter);
+            spdlog::info("Kept {} files up to date, removed {} files no longer in their archive", manifest->getUpToDateCount(), removed);
+            stats.setValue("up_to_date", static_cast<double>(manifest->getUpToDateCount()));
+            stats.setValue("removed", static_cast<double>(removed));
+            try {
+                manifest->save();
+            } catch (const std::ios_base::failure &e) {
+                spdlog::error("Error: {}", e.what());
+                failed = true;
+            }
+        }
+    }
+    if (!options._list && options._command != "diff") {
+        utils::stopAsyncLogging(options._stdout);
+    }
+
+    if (statsOrNull) {
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        stats.setValue("archives", static_cast<double>(options._inputFiles.size() + options._commandArgs.size()));
+        stats.setValue("failed", failed ? 1.0 : 0.0);
+        stats.setValue("jobs", static_cast<double>(pool.getThreadCount()));
+        stats.setValue("seconds", elapsed.count());
+        if (options._statsPath == "-") {
+            spdlog::fmt_lib::print("{}", stats.toJson());
+        } else {
+            std::ofstream statsFile(options._statsPath, std::ios::out | std::ios::trunc);
+            statsFile << stats.toJson();
+            if (!statsFile) {
+                spdlog::error("Error: Failed to write stats to {}", options._statsPath);
+                return 1;
+            }
+        }
     }
-    return 1;
-}
\ No newline at end of file
+    return failed ? 1 : 0;
+}
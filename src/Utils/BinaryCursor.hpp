@@ -0,0 +1,112 @@
+#ifndef BINARY_CURSOR_HPP
+#define BINARY_CURSOR_HPP
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include "Utils/Utils.hpp"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+    #include <immintrin.h>
+    #define NTT_SSSE3_DISPATCH 1
+#endif
+
+namespace utils
+{
+    template <std::endian Order, typename T>
+    inline T fromEndian(T value) noexcept
+    {
+        static_assert(std::is_integral_v<T>, "T must be an integral type");
+        if constexpr (Order == std::endian::native || sizeof(T) == 1) {
+            return value;
+        } else {
+            return utils::byteswap(value);
+        }
+    }
+
+    // Fixed width fields of a byte range in a given byte order. Offsets are absolute, the range starting at base,
+    // and every read is checked against the end of the range: std::out_of_range instead of reading past it.
+    template <std::endian Order>
+    class BinaryCursor
+    {
+        public:
+            BinaryCursor(std::span<const std::byte> data, std::size_t base) noexcept : _data(data), _base(base) {}
+
+            std::size_t getBase() const noexcept { return _base; }
+            std::size_t getEnd() const noexcept { return _base + _data.size(); }
+
+            // The count bytes at offset, checked
+            std::span<const std::byte> bytes(std::size_t offset, std::size_t count) const
+            {
+                if (offset < _base || offset - _base > _data.size() || count > _data.size() - (offset - _base)) {
+                    throw std::out_of_range("Read of " + std::to_string(count) + " bytes at offset " + std::to_string(offset) + " is out of bounds.");
+                }
+                return _data.subspan(offset - _base, count);
+            }
+
+            template <typename T>
+            T read(std::size_t offset) const
+            {
+                T value;
+                std::memcpy(&value, bytes(offset, sizeof(T)).data(), sizeof(T));
+                return fromEndian<Order>(value);
+            }
+
+        private:
+            std::span<const std::byte> _data;
+            std::size_t _base;
+    };
+
+    using BigEndianCursor = BinaryCursor<std::endian::big>;
+
+    namespace detail
+    {
+        inline void loadBigEndian32Scalar(const std::byte *source, std::uint32_t *destination, std::size_t count) noexcept
+        {
+            for (std::size_t index = 0ull; index < count; ++index) {
+                std::uint32_t value;
+                std::memcpy(&value, source + index * 4, sizeof(value));
+                destination[index] = fromEndian<std::endian::big>(value);
+            }
+        }
+
+#ifdef NTT_SSSE3_DISPATCH
+        // Four words per shuffle, the tail goes through the scalar loop
+        __attribute__((target("ssse3"))) inline void loadBigEndian32Ssse3(const std::byte *source, std::uint32_t *destination, std::size_t count) noexcept
+        {
+            const __m128i swap = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+            std::size_t index = 0ull;
+            for (; index + 4 <= count; index += 4) {
+                const __m128i words = _mm_loadu_si128(reinterpret_cast<const __m128i *>(source + index * 4));
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(destination + index), _mm_shuffle_epi8(words, swap));
+            }
+            loadBigEndian32Scalar(source + index * 4, destination + index, count - index);
+        }
+#endif
+    } // namespace detail
+
+    // Decodes destination.size() consecutive big-endian 32 bits words starting at offset in one go
+    inline void loadBigEndian32(const BigEndianCursor &cursor, std::size_t offset, std::span<std::uint32_t> destination)
+    {
+        const std::byte *source = cursor.bytes(offset, destination.size() * 4).data();
+        if constexpr (std::endian::native == std::endian::big) {
+            std::memcpy(destination.data(), source, destination.size_bytes());
+            return;
+        }
+#ifdef NTT_SSSE3_DISPATCH
+        static const bool hasSsse3 = __builtin_cpu_supports("ssse3");
+        if (hasSsse3) {
+            detail::loadBigEndian32Ssse3(source, destination.data(), destination.size());
+            return;
+        }
+#endif
+        detail::loadBigEndian32Scalar(source, destination.data(), destination.size());
+    }
+} // namespace utils
+
+#endif // BINARY_CURSOR_HPP
@@ -0,0 +1,45 @@
+#ifndef LOGGING_HPP
+#define LOGGING_HPP
+
+#include <cstddef>
+#include <memory>
+#include "spdlog/spdlog.h"
+#include "spdlog/async.h"
+#include "spdlog/sinks/stdout_color_sinks.h"
+
+namespace utils
+{
+    static constexpr std::size_t LOG_QUEUE_SIZE = 32768; // Lines queued before loggers block
+
+    // Console sink of the loggers, the standard error when the standard output carries data
+    inline spdlog::sink_ptr consoleSink(bool toStderr)
+    {
+        if (toStderr) {
+            return std::make_shared<spdlog::sinks::stderr_color_sink_mt>();
+        }
+        return std::make_shared<spdlog::sinks::stdout_color_sink_mt>();
+    }
+
+    // Replaces the default logger with one printing from a background thread,
+    // so that workers flushing thousands of entry lines only pay for queuing them.
+    inline void startAsyncLogging(spdlog::level::level_enum level, bool toStderr = false)
+    {
+        spdlog::init_thread_pool(LOG_QUEUE_SIZE, 1);
+        auto sink = consoleSink(toStderr);
+        auto logger = std::make_shared<spdlog::async_logger>("", sink, spdlog::thread_pool(), spdlog::async_overflow_policy::block);
+        logger->set_level(level);
+        spdlog::set_default_logger(logger);
+    }
+
+    // Waits for every queued line to be printed, then goes back to a synchronous default logger
+    inline void stopAsyncLogging(bool toStderr = false)
+    {
+        const spdlog::level::level_enum level = spdlog::get_level();
+        spdlog::shutdown();
+        auto logger = std::make_shared<spdlog::logger>("", consoleSink(toStderr));
+        logger->set_level(level);
+        spdlog::set_default_logger(logger);
+    }
+} // namespace utils
+
+#endif // LOGGING_HPP
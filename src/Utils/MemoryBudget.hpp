@@ -0,0 +1,110 @@
+#ifndef MEMORYBUDGET_HPP
+#define MEMORYBUDGET_HPP
+
+#include <cctype>
+#include <charconv>
+#include <condition_variable>
+#include <cstddef>
+#include <limits>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+
+namespace utils
+{
+    // Caps the memory held by archives and entries in flight. A limit of 0 means unlimited.
+    // Archives are admitted while they fit, or when nothing else is held.
+    // Entries are admitted while they fit, or when no other entry is being decoded, which
+    // guarantees progress: entries are what eventually release their archive.
+    class MemoryBudget
+    {
+        public:
+            explicit MemoryBudget(std::size_t limit = 0ull) : _limit(limit) {}
+
+            std::size_t getLimit() const noexcept { return _limit; }
+
+            void acquireArchive(std::size_t bytes);
+            void releaseArchive(std::size_t bytes);
+            void acquireEntry(std::size_t bytes);
+            void releaseEntry(std::size_t bytes);
+
+        private:
+            const std::size_t _limit;
+            std::size_t _used{0};
+            std::size_t _entriesInFlight{0};
+            std::mutex _mutex;
+            std::condition_variable _released;
+
+            bool _fits(std::size_t bytes) const noexcept { return _limit == 0 || _used + bytes <= _limit; }
+    };
+
+    void MemoryBudget::acquireArchive(std::size_t bytes)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _released.wait(lock, [this, bytes]() { return _fits(bytes) || _used == 0; });
+        _used += bytes;
+    }
+
+    void MemoryBudget::releaseArchive(std::size_t bytes)
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _used -= bytes;
+        }
+        _released.notify_all();
+    }
+
+    void MemoryBudget::acquireEntry(std::size_t bytes)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _released.wait(lock, [this, bytes]() { return _fits(bytes) || _entriesInFlight == 0; });
+        _used += bytes;
+        _entriesInFlight += 1;
+    }
+
+    void MemoryBudget::releaseEntry(std::size_t bytes)
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _used -= bytes;
+            _entriesInFlight -= 1;
+        }
+        _released.notify_all();
+    }
+
+    // Parses sizes such as "512M", "2G" or "1048576". Throws std::invalid_argument for anything else
+    // and std::out_of_range for sizes that do not fit a std::size_t.
+    inline std::size_t parseByteSize(const std::string &text)
+    {
+        std::size_t value = 0ull;
+        const auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+        if (error == std::errc::result_out_of_range) {
+            throw std::out_of_range("Size too large: " + text);
+        } else if (error != std::errc()) {
+            throw std::invalid_argument("Invalid size: " + text);
+        }
+        std::string suffix(end, text.data() + text.size());
+        for (char &c : suffix) {
+            c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+        }
+
+        unsigned shift = 0u;
+        if (suffix.empty() || suffix == "B") {
+            shift = 0u;
+        } else if (suffix == "K" || suffix == "KB" || suffix == "KIB") {
+            shift = 10u;
+        } else if (suffix == "M" || suffix == "MB" || suffix == "MIB") {
+            shift = 20u;
+        } else if (suffix == "G" || suffix == "GB" || suffix == "GIB") {
+            shift = 30u;
+        } else {
+            throw std::invalid_argument("Unknown size suffix: " + text);
+        }
+        if (value > (std::numeric_limits<std::size_t>::max() >> shift)) {
+            throw std::out_of_range("Size too large: " + text);
+        }
+        return value << shift;
+    }
+} // namespace utils
+
+#endif // MEMORYBUDGET_HPP
@@ -0,0 +1,97 @@
+#ifndef PATHFILTER_HPP
+#define PATHFILTER_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include "Utils/PathHash.hpp"
+
+namespace utils
+{
+    // Glob matching over archive paths, ignoring case and treating '/' and '\' alike like the archive CRCs do.
+    // '?' matches one character and '*' any run of characters within a directory, "**" also crosses directories.
+    inline bool globMatch(std::string_view pattern, std::string_view path)
+    {
+        auto isSeparator = [](char c) { return c == '/' || c == '\\'; };
+        std::size_t p = 0ull;
+        std::size_t s = 0ull;
+
+        while (p < pattern.size()) {
+            if (pattern[p] == '*') {
+                const bool deep = p + 1 < pattern.size() && pattern[p + 1] == '*';
+                p += deep ? 2 : 1;
+                if (p == pattern.size()) {
+                    return deep || path.find_first_of("/\\", s) == std::string_view::npos;
+                }
+                // "**/" also matches no directory at all
+                if (deep && isSeparator(pattern[p]) && globMatch(pattern.substr(p + 1), path.substr(s))) {
+                    return true;
+                }
+                for (std::size_t k = s; k <= path.size(); ++k) {
+                    if (globMatch(pattern.substr(p), path.substr(k))) {
+                        return true;
+                    }
+                    if (k < path.size() && !deep && isSeparator(path[k])) {
+                        break;
+                    }
+                }
+                return false;
+            }
+            if (s == path.size()) {
+                return false;
+            }
+            if (pattern[p] == '?') {
+                if (isSeparator(path[s])) {
+                    return false;
+                }
+            } else if (PATH_HASH_NORMALIZE[static_cast<std::uint8_t>(pattern[p])] != PATH_HASH_NORMALIZE[static_cast<std::uint8_t>(path[s])]) {
+                return false;
+            }
+            ++p;
+            ++s;
+        }
+        return s == path.size();
+    }
+
+    // Selects paths matching any include pattern (or every path if there is none) and no exclude pattern.
+    // A pattern without any separator is matched against the file name only, so "*.bin" works at any depth.
+    class PathFilter
+    {
+        public:
+            void addInclude(const std::string &pattern) { _includes.push_back(pattern); }
+            void addExclude(const std::string &pattern) { _excludes.push_back(pattern); }
+
+            bool empty() const noexcept { return _includes.empty() && _excludes.empty(); }
+            bool matches(std::string_view path) const;
+
+        private:
+            std::vector<std::string> _includes;
+            std::vector<std::string> _excludes;
+
+            static bool _matchesAny(const std::vector<std::string> &patterns, std::string_view path);
+    };
+
+    inline bool PathFilter::_matchesAny(const std::vector<std::string> &patterns, std::string_view path)
+    {
+        const std::size_t nameBegin = path.find_last_of("/\\");
+        const std::string_view fileName = nameBegin == std::string_view::npos ? path : path.substr(nameBegin + 1);
+
+        for (const std::string &pattern : patterns) {
+            const bool hasSeparator = pattern.find_first_of("/\\") != std::string::npos;
+            if (globMatch(pattern, hasSeparator ? path : fileName)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    inline bool PathFilter::matches(std::string_view path) const
+    {
+        if (!_includes.empty() && !_matchesAny(_includes, path)) {
+            return false;
+        }
+        return !_matchesAny(_excludes, path);
+    }
+} // namespace utils
+
+#endif // PATHFILTER_HPP
@@ -0,0 +1,88 @@
+#ifndef PATHHASH_HPP
+#define PATHHASH_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string_view>
+
+namespace utils
+{
+    // Archives index their entries by an FNV-like hash of the path, upper-cased and with '\' separators.
+    static constexpr std::uint32_t PATH_HASH_OFFSET = 0x811c9dc5;
+    static constexpr std::uint32_t PATH_HASH_PRIME = 0x199933;
+
+    // Normalized value of every byte: ASCII upper-case, '/' becomes '\', everything else unchanged
+    inline constexpr std::array<std::uint8_t, 256> PATH_HASH_NORMALIZE = []() {
+        std::array<std::uint8_t, 256> table{};
+        for (std::size_t c = 0ull; c < table.size(); ++c) {
+            table[c] = static_cast<std::uint8_t>(c);
+            if (c >= 'a' && c <= 'z') {
+                table[c] = static_cast<std::uint8_t>(c - 'a' + 'A');
+            } else if (c == '/') {
+                table[c] = '\\';
+            }
+        }
+        return table;
+    }();
+
+    // Normalizes and hashes in a single pass, without building the normalized path
+    inline std::uint32_t pathHash(std::string_view path) noexcept
+    {
+        std::uint32_t hash = PATH_HASH_OFFSET;
+        for (const char c : path) {
+            hash ^= PATH_HASH_NORMALIZE[static_cast<std::uint8_t>(c)];
+            hash *= PATH_HASH_PRIME;
+        }
+        return hash;
+    }
+
+    // Whether two paths hash the same way for a reason other than a collision
+    inline bool pathEquals(std::string_view lhs, std::string_view rhs) noexcept
+    {
+        if (lhs.size() != rhs.size()) {
+            return false;
+        }
+        for (std::size_t i = 0ull; i < lhs.size(); ++i) {
+            if (PATH_HASH_NORMALIZE[static_cast<std::uint8_t>(lhs[i])] != PATH_HASH_NORMALIZE[static_cast<std::uint8_t>(rhs[i])]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Same as pathHash over many paths. Each hash is one long chain of dependent multiplies,
+    // so four paths are walked side by side to keep the multiplier busy.
+    inline void pathHashBatch(std::span<const std::string_view> paths, std::span<std::uint32_t> hashes) noexcept
+    {
+        static constexpr std::size_t LANES = 4ull;
+        std::size_t pathIndex = 0ull;
+
+        for (; pathIndex + LANES <= paths.size(); pathIndex += LANES) {
+            const std::string_view *lane = paths.data() + pathIndex;
+            std::uint32_t hash[LANES] = {PATH_HASH_OFFSET, PATH_HASH_OFFSET, PATH_HASH_OFFSET, PATH_HASH_OFFSET};
+            std::size_t common = lane[0].size();
+            for (std::size_t l = 1ull; l < LANES; ++l) {
+                common = lane[l].size() < common ? lane[l].size() : common;
+            }
+
+            for (std::size_t i = 0ull; i < common; ++i) {
+                for (std::size_t l = 0ull; l < LANES; ++l) {
+                    hash[l] = (hash[l] ^ PATH_HASH_NORMALIZE[static_cast<std::uint8_t>(lane[l][i])]) * PATH_HASH_PRIME;
+                }
+            }
+            for (std::size_t l = 0ull; l < LANES; ++l) {
+                for (std::size_t i = common; i < lane[l].size(); ++i) {
+                    hash[l] = (hash[l] ^ PATH_HASH_NORMALIZE[static_cast<std::uint8_t>(lane[l][i])]) * PATH_HASH_PRIME;
+                }
+                hashes[pathIndex + l] = hash[l];
+            }
+        }
+        for (; pathIndex < paths.size(); ++pathIndex) {
+            hashes[pathIndex] = pathHash(paths[pathIndex]);
+        }
+    }
+} // namespace utils
+
+#endif // PATHHASH_HPP
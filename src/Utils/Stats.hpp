@@ -0,0 +1,174 @@
+#ifndef STATS_HPP
+#define STATS_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "spdlog/spdlog.h"
+
+namespace utils
+{
+    // Time, volumes and entry counts of each pipeline stage and of each codec, summed over every archive.
+    // Stages run by several workers at once report the time summed over the workers, not the elapsed time.
+    // Thread safe; stages and codecs are reported in the order they were first seen.
+    class Stats
+    {
+        public:
+            struct Counters {
+                double _seconds{0.0};
+                std::size_t _bytesIn{0};
+                std::size_t _bytesOut{0};
+                std::size_t _entries{0};
+
+                Counters &operator+=(const Counters &other);
+            };
+
+            // Adds the lifetime of the timer to a stage. Does nothing, not even reading the clock, without stats.
+            class Timer
+            {
+                public:
+                    Timer(Stats *stats, std::string_view stage);
+                    ~Timer();
+
+                    Timer(const Timer &) = delete;
+                    Timer &operator=(const Timer &) = delete;
+
+                    void setBytes(std::size_t bytesIn, std::size_t bytesOut) noexcept { _counters._bytesIn = bytesIn; _counters._bytesOut = bytesOut; }
+                    void setEntries(std::size_t entries) noexcept { _counters._entries = entries; }
+
+                private:
+                    Stats *_stats;
+                    std::string_view _stage;
+                    Counters _counters;
+                    std::chrono::steady_clock::time_point _start;
+            };
+
+            void addStage(std::string_view stage, const Counters &counters);
+            void addCodec(std::string_view codec, const Counters &counters);
+            // Archive reads, of which sequential ones continue where the previous read ended
+            void addReads(std::size_t reads, std::size_t sequentialReads, std::size_t bytes);
+            // Top level figures, such as the number of archives or the total elapsed time
+            void setValue(std::string_view name, double value);
+
+            std::string toJson() const;
+
+        private:
+            using Table = std::vector<std::pair<std::string, Counters>>;
+
+            mutable std::mutex _mutex;
+            Table _stages;
+            Table _codecs;
+            std::vector<std::pair<std::string, double>> _values;
+            std::size_t _reads{0};
+            std::size_t _sequentialReads{0};
+            std::size_t _readBytes{0};
+
+            static void _add(Table &table, std::string_view name, const Counters &counters);
+            static void _appendTable(std::string &json, std::string_view name, const Table &table);
+    };
+
+    inline Stats::Counters &Stats::Counters::operator+=(const Counters &other)
+    {
+        _seconds += other._seconds;
+        _bytesIn += other._bytesIn;
+        _bytesOut += other._bytesOut;
+        _entries += other._entries;
+        return *this;
+    }
+
+    inline Stats::Timer::Timer(Stats *stats, std::string_view stage)
+        : _stats(stats), _stage(stage)
+    {
+        if (_stats) {
+            _start = std::chrono::steady_clock::now();
+        }
+    }
+
+    inline Stats::Timer::~Timer()
+    {
+        if (_stats) {
+            const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - _start;
+            _counters._seconds = elapsed.count();
+            _stats->addStage(_stage, _counters);
+        }
+    }
+
+    inline void Stats::_add(Table &table, std::string_view name, const Counters &counters)
+    {
+        for (auto &[tableName, tableCounters] : table) {
+            if (tableName == name) {
+                tableCounters += counters;
+                return;
+            }
+        }
+        table.emplace_back(std::string(name), counters);
+    }
+
+    inline void Stats::addStage(std::string_view stage, const Counters &counters)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _add(_stages, stage, counters);
+    }
+
+    inline void Stats::addCodec(std::string_view codec, const Counters &counters)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _add(_codecs, codec, counters);
+    }
+
+    inline void Stats::addReads(std::size_t reads, std::size_t sequentialReads, std::size_t bytes)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _reads += reads;
+        _sequentialReads += sequentialReads;
+        _readBytes += bytes;
+    }
+
+    inline void Stats::setValue(std::string_view name, double value)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (auto &[valueName, tableValue] : _values) {
+            if (valueName == name) {
+                tableValue = value;
+                return;
+            }
+        }
+        _values.emplace_back(std::string(name), value);
+    }
+
+    inline void Stats::_appendTable(std::string &json, std::string_view name, const Table &table)
+    {
+        json += spdlog::fmt_lib::format("  \"{}\": [", name);
+        for (std::size_t i = 0ull; i < table.size(); ++i) {
+            const auto &[rowName, counters] = table[i];
+            const double megabytesPerSecond = counters._seconds > 0.0 ? counters._bytesOut / 1048576.0 / counters._seconds : 0.0;
+            json += spdlog::fmt_lib::format("{}\n    {{\"name\": \"{}\", \"seconds\": {:.6f}, \"bytes_in\": {}, \"bytes_out\": {}, \"entries\": {}, \"mb_per_s\": {:.1f}}}",
+                i == 0 ? "" : ",", rowName, counters._seconds, counters._bytesIn, counters._bytesOut, counters._entries, megabytesPerSecond);
+        }
+        json += table.empty() ? "]" : "\n  ]";
+    }
+
+    inline std::string Stats::toJson() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        std::string json = "{\n";
+        for (const auto &[name, value] : _values) {
+            json += spdlog::fmt_lib::format("  \"{}\": {},\n", name, value);
+        }
+        if (_reads != 0) {
+            json += spdlog::fmt_lib::format("  \"reads\": {{\"count\": {}, \"bytes\": {}, \"sequential\": {}, \"sequentiality\": {:.3f}, \"average_size\": {}}},\n",
+                _reads, _readBytes, _sequentialReads, static_cast<double>(_sequentialReads) / _reads, _readBytes / _reads);
+        }
+        _appendTable(json, "stages", _stages);
+        json += ",\n";
+        _appendTable(json, "codecs", _codecs);
+        json += "\n}\n";
+        return json;
+    }
+} // namespace utils
+
+#endif // STATS_HPP
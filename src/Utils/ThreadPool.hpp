@@ -0,0 +1,178 @@
+#ifndef THREADPOOL_HPP
+#define THREADPOOL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace utils
+{
+    // Work-stealing thread pool. Every worker owns a queue: tasks are dealt round-robin,
+    // a worker runs its own tasks in submission order and, once idle, steals from the back of the others.
+    // Tasks receive the index of the worker running them, to pick per-worker state.
+    class ThreadPool
+    {
+        public:
+            using Task = std::function<void(std::size_t workerIndex)>;
+
+            explicit ThreadPool(std::size_t threadCount = defaultThreadCount());
+            ~ThreadPool();
+
+            ThreadPool(const ThreadPool &) = delete;
+            ThreadPool &operator=(const ThreadPool &) = delete;
+
+            std::size_t getThreadCount() const noexcept { return _workers.size(); }
+
+            void submit(Task task);
+            // Queues task on the worker queue picked by key, behind the tasks submitted with the same key:
+            // they run in order on one worker unless idle workers steal them.
+            void submitTo(std::size_t key, Task task);
+            // Blocks until every submitted task ran, rethrows the first exception a task let escape.
+            void wait();
+
+            static std::size_t defaultThreadCount() noexcept;
+
+        private:
+            struct WorkQueue {
+                std::mutex _mutex;
+                std::deque<Task> _tasks;
+            };
+
+            std::vector<std::unique_ptr<WorkQueue>> _queues;
+            std::vector<std::thread> _workers;
+            std::atomic<std::size_t> _nextQueue{0};
+            std::atomic<std::size_t> _queued{0};
+            std::atomic<std::size_t> _pending{0};
+            std::mutex _stateMutex;
+            std::condition_variable _wakeCondition;
+            std::condition_variable _doneCondition;
+            std::exception_ptr _error;
+            bool _stop{false};
+
+            bool _popTask(std::size_t workerIndex, Task &task);
+            void _workerLoop(std::size_t workerIndex);
+    };
+
+    ThreadPool::ThreadPool(std::size_t threadCount)
+    {
+        threadCount = std::max<std::size_t>(threadCount, 1ull);
+        for (std::size_t i = 0; i < threadCount; ++i) {
+            _queues.push_back(std::make_unique<WorkQueue>());
+        }
+        for (std::size_t i = 0; i < threadCount; ++i) {
+            _workers.emplace_back([this, i]() { _workerLoop(i); });
+        }
+    }
+
+    ThreadPool::~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_stateMutex);
+            _stop = true;
+        }
+        _wakeCondition.notify_all();
+        for (std::thread &worker : _workers) {
+            worker.join();
+        }
+    }
+
+    std::size_t ThreadPool::defaultThreadCount() noexcept
+    {
+        return std::max(std::thread::hardware_concurrency(), 1u);
+    }
+
+    void ThreadPool::submit(Task task)
+    {
+        submitTo(_nextQueue.fetch_add(1, std::memory_order_relaxed), std::move(task));
+    }
+
+    void ThreadPool::submitTo(std::size_t key, Task task)
+    {
+        // Counted before the queue lock is released: a worker can only pop the task, and decrement the counts, after that.
+        // Workers never take a queue lock while holding _stateMutex, so nesting it here cannot deadlock.
+        WorkQueue &queue = *_queues[key % _queues.size()];
+        {
+            std::lock_guard<std::mutex> lock(queue._mutex);
+            queue._tasks.push_back(std::move(task));
+            std::lock_guard<std::mutex> stateLock(_stateMutex);
+            _pending += 1;
+            _queued += 1;
+        }
+        _wakeCondition.notify_one();
+    }
+
+    void ThreadPool::wait()
+    {
+        std::unique_lock<std::mutex> lock(_stateMutex);
+        _doneCondition.wait(lock, [this]() { return _pending == 0; });
+        if (_error) {
+            std::exception_ptr error = std::exchange(_error, nullptr);
+            std::rethrow_exception(error);
+        }
+    }
+
+    bool ThreadPool::_popTask(std::size_t workerIndex, Task &task)
+    {
+        {
+            WorkQueue &own = *_queues[workerIndex];
+            std::lock_guard<std::mutex> lock(own._mutex);
+            if (!own._tasks.empty()) {
+                task = std::move(own._tasks.front());
+                own._tasks.pop_front();
+                return true;
+            }
+        }
+        for (std::size_t offset = 1; offset < _queues.size(); ++offset) {
+            WorkQueue &victim = *_queues[(workerIndex + offset) % _queues.size()];
+            std::lock_guard<std::mutex> lock(victim._mutex);
+            if (!victim._tasks.empty()) {
+                task = std::move(victim._tasks.back());
+                victim._tasks.pop_back();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void ThreadPool::_workerLoop(std::size_t workerIndex)
+    {
+        Task task;
+
+        while (true) {
+            if (_popTask(workerIndex, task)) {
+                _queued -= 1;
+                try {
+                    task(workerIndex);
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock(_stateMutex);
+                    if (!_error) {
+                        _error = std::current_exception();
+                    }
+                }
+                task = nullptr;
+                if (_pending.fetch_sub(1) == 1) {
+                    std::lock_guard<std::mutex> lock(_stateMutex);
+                    _doneCondition.notify_all();
+                }
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(_stateMutex);
+            _wakeCondition.wait(lock, [this]() { return _stop || _queued > 0; });
+            if (_stop && _queued == 0) {
+                return;
+            }
+        }
+    }
+} // namespace utils
+
+#endif // THREADPOOL_HPP
@@ -1,5 +1,6 @@
 add_rules("mode.debug", "mode.release")
 add_requires("spdlog", "zlib")
+add_requires("benchmark", {optional = true})
 
 set_languages("c++20")
 set_policy("build.warning", true)
@@ -10,6 +11,7 @@ add_packages("spdlog", "zlib")
 
 includes("lib/ZipX")
 includes("lib/LZ2K")
+includes("lib/Archive")
 
 target("NTT-Dat-Exporter")
     set_kind("binary")
@@ -17,6 +19,20 @@ target("NTT-Dat-Exporter")
     add_files("src/*.cpp")
     add_linkdirs("$(buildir)")
     add_deps("ZipX", "LZ2K")
+    if is_plat("linux") then
+        add_syslinks("pthread")
+    end
+
+target("bench")
+    set_kind("binary")
+    set_default(false)
+    add_includedirs("include", "src", "bench")
+    add_files("bench/*.cpp")
+    add_deps("ZipX", "LZ2K")
+    add_packages("benchmark")
+    if is_plat("linux") then
+        add_syslinks("pthread")
+    end
 
 --
 -- If you want to known more usage about xmake, please see https://xmake.io